@@ -4,22 +4,29 @@
 #include <stddef.h>
 #include <stdbool.h>
 
-typedef struct best_fit_block_header {
-    size_t size;
-    bool is_free;
+#include "list_fit.h"
+#include "strategy.h"
 
-    struct best_fit_block_header *next_free;
-    struct best_fit_block_header *prev_free;
-} best_fit_block_header_t;
+typedef list_fit_heap_t best_fit_heap_t;
 
-#define BEST_FIT_HEADER_SIZE sizeof(best_fit_block_header_t)
+int best_fit_init(best_fit_heap_t *heap, const region_config_t *config);
+void *best_fit_malloc(best_fit_heap_t *heap, size_t size);
+void *best_fit_memalign(best_fit_heap_t *heap, size_t alignment, size_t size);
+void *best_fit_resize(best_fit_heap_t *heap, void *ptr, size_t size);
+void best_fit_free(best_fit_heap_t *heap, void *ptr);
+size_t best_fit_malloc_batch(best_fit_heap_t *heap, size_t size, size_t count, void **out);
+void best_fit_free_batch(best_fit_heap_t *heap, void **ptrs, size_t count);
+void best_fit_purge(best_fit_heap_t *heap);
+void best_fit_destroy(best_fit_heap_t *heap);
 
-int best_fit_init(size_t initial_size);
-void* best_fit_malloc(size_t size);
-void best_fit_free(void *ptr);
+size_t best_fit_get_total_mapped_memory(best_fit_heap_t *heap);
+size_t best_fit_get_total_released_memory(best_fit_heap_t *heap);
+size_t best_fit_get_currently_allocated_memory(best_fit_heap_t *heap);
+size_t best_fit_get_structural_overhead(best_fit_heap_t *heap);
+void best_fit_get_stats(best_fit_heap_t *heap, strategy_stats_t *stats);
+bool best_fit_peek_stats(best_fit_heap_t *heap, strategy_stats_t *stats);
+region_list_t *best_fit_get_regions(best_fit_heap_t *heap);
 
-size_t best_fit_get_total_mapped_memory();
-size_t best_fit_get_currently_allocated_memory();
-size_t best_fit_get_structural_overhead();
+extern const strategy_ops_t best_fit_ops;
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,206 @@
+#ifndef BLOCK_H
+#define BLOCK_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+
+// Every payload is aligned to this many bytes, alignof(max_align_t) on the usual 64-bit ABIs.
+// Set through the TDMM_ALIGNMENT CMake option
+#ifndef TDMM_ALIGNMENT
+#define TDMM_ALIGNMENT 16
+#endif
+#if TDMM_ALIGNMENT < 8 || TDMM_ALIGNMENT > 256 || (TDMM_ALIGNMENT & (TDMM_ALIGNMENT - 1)) != 0
+#error "TDMM_ALIGNMENT must be a power of two between 8 and 256"
+#endif
+#define BLOCK_ALIGN ((size_t)TDMM_ALIGNMENT)
+
+/**
+ * Block layout shared by every strategy.
+ *
+ * An allocated block costs a single word: its size with the flags below packed into
+ * the low bits (sizes are multiples of 8) and two tag bytes in the high bits. The free
+ * list links only exist while the block is free and live in the first payload words:
+ *
+ *   allocated: [ size | flags ][ payload ...                    ]
+ *   free:      [ size | flags ][ next_free ][ prev_free ] ... [ size ]
+ *
+ * Header plus payload always spans a multiple of BLOCK_ALIGN and every region starts
+ * its first header BLOCK_PAD bytes in, so each payload lands on a BLOCK_ALIGN boundary.
+ *
+ * Free blocks repeat their size in a footer (the last word of the payload) and
+ * tell their right neighbour through its BLOCK_PREV_FREE flag, so a block can find
+ * both physical neighbours without consulting any free list. Every region ends
+ * with a zero-sized allocated epilogue header so coalescing stops at the region edge.
+ */
+typedef struct block_header {
+    size_t size_flags;
+
+    // Only valid while the block is free, these overlap the payload
+    struct block_header *next_free;
+    struct block_header *prev_free;
+} block_header_t;
+
+#define BLOCK_FREE ((size_t)1 << 0)
+#define BLOCK_PREV_FREE ((size_t)1 << 1)  // Physical left neighbour is free (its footer is valid)
+#define BLOCK_PURGED ((size_t)1 << 2)     // Free block whose interior pages were handed back with madvise
+
+// Top byte: owning arena, stamped by tdmm.c on allocation. Next byte: decay epoch
+// a free block became dirty in, see region.c
+#define BLOCK_ARENA_SHIFT 56
+#define BLOCK_EPOCH_SHIFT 48
+// Free block carved from untouched pages: only its links and footer were ever written,
+// every other payload byte is still zero. Kept on the block when it is allocated
+#define BLOCK_ZEROED ((size_t)1 << 47)
+#define BLOCK_SIZE_MASK ((BLOCK_ZEROED - 1) & ~(size_t)7)
+
+#define HEADER_SIZE sizeof(size_t)
+#define FOOTER_SIZE sizeof(size_t)
+// Bytes in front of a region's first header that put its payload on the boundary
+#define BLOCK_PAD (BLOCK_ALIGN - HEADER_SIZE)
+// Smallest block, a free block must be able to hold its links and footer
+#define MIN_BLOCK_SIZE ((sizeof(block_header_t) + FOOTER_SIZE + BLOCK_ALIGN - 1) & ~(BLOCK_ALIGN - 1))
+#define MIN_PAYLOAD (MIN_BLOCK_SIZE - HEADER_SIZE)
+
+/**
+ * Returns the payload size of the smallest block that holds size bytes,
+ * or 0 if size is too large to be represented
+ */
+static inline size_t block_payload_size(size_t size) {
+    if (size > BLOCK_SIZE_MASK - MIN_BLOCK_SIZE) return 0;
+    size_t footprint = (size + HEADER_SIZE + BLOCK_ALIGN - 1) & ~(BLOCK_ALIGN - 1);
+    return footprint < MIN_BLOCK_SIZE ? MIN_PAYLOAD : footprint - HEADER_SIZE;
+}
+
+static inline size_t block_size(const block_header_t *block) {
+    return block->size_flags & BLOCK_SIZE_MASK;
+}
+
+/**
+ * Changes the size, keeping flags and tags
+ */
+static inline void block_set_size(block_header_t *block, size_t size) {
+    block->size_flags = (block->size_flags & ~BLOCK_SIZE_MASK) | size;
+}
+
+static inline bool block_has(const block_header_t *block, size_t flag) {
+    return (block->size_flags & flag) != 0;
+}
+
+static inline void block_set(block_header_t *block, size_t flag, bool on) {
+    if (on) block->size_flags |= flag;
+    else block->size_flags &= ~flag;
+}
+
+/**
+ * Heap stats are only written under the arena's lock, but the t_get_* functions read them
+ * without it. Each side is one relaxed atomic access, the single writer needs no read-modify-write
+ */
+#define STAT_SET(field, value) __atomic_store_n(&(field), (value), __ATOMIC_RELAXED)
+#define STAT_ADD(field, n) STAT_SET(field, (field) + (n))
+#define STAT_SUB(field, n) STAT_SET(field, (field) - (n))
+#define STAT_LOAD(field) __atomic_load_n(&(field), __ATOMIC_RELAXED)
+
+/**
+ * Sets or clears flags of a header other threads may update at the same time. The arena
+ * flips BLOCK_PREV_FREE of an allocated block when its left neighbour is freed or reused,
+ * while the block's owner clears BLOCK_ZEROED without the arena's lock when it parks the
+ * block in its thread cache. In thread-safe builds both sides use one atomic
+ * read-modify-write, so neither can undo the other's update
+ */
+static inline void block_set_atomic(block_header_t *block, size_t flag, bool on) {
+#ifdef TDMM_THREAD_SAFE
+    if (on) __atomic_fetch_or(&block->size_flags, flag, __ATOMIC_RELAXED);
+    else __atomic_fetch_and(&block->size_flags, ~flag, __ATOMIC_RELAXED);
+#else
+    block_set(block, flag, on);
+#endif
+}
+
+/**
+ * Reads a header word that other threads may update at the same time, see block_set_atomic
+ */
+static inline size_t block_flags(const block_header_t *block) {
+    return __atomic_load_n(&block->size_flags, __ATOMIC_RELAXED);
+}
+
+static inline bool block_is_free(const block_header_t *block) {
+    return block_has(block, BLOCK_FREE);
+}
+
+static inline bool block_prev_is_free(const block_header_t *block) {
+    return block_has(block, BLOCK_PREV_FREE);
+}
+
+/**
+ * Read without the arena's lock by whoever frees the block, so it is loaded atomically
+ */
+static inline unsigned char block_owner(const block_header_t *block) {
+    return (unsigned char)(block_flags(block) >> BLOCK_ARENA_SHIFT);
+}
+
+static inline void block_set_owner(block_header_t *block, unsigned char arena) {
+    block->size_flags = (block->size_flags & ~((size_t)0xff << BLOCK_ARENA_SHIFT)) | ((size_t)arena << BLOCK_ARENA_SHIFT);
+}
+
+static inline unsigned char block_epoch(const block_header_t *block) {
+    return (unsigned char)(block->size_flags >> BLOCK_EPOCH_SHIFT);
+}
+
+static inline void block_set_epoch(block_header_t *block, unsigned char epoch) {
+    block->size_flags = (block->size_flags & ~((size_t)0xff << BLOCK_EPOCH_SHIFT)) | ((size_t)epoch << BLOCK_EPOCH_SHIFT);
+}
+
+static inline block_header_t *block_next(block_header_t *block) {
+    return (block_header_t *)((char *)block + HEADER_SIZE + block_size(block));
+}
+
+/**
+ * Merges next, the free block right after block, into block. The result is only purged
+ * or zeroed if both were, and stays zeroed by clearing the tags at the seam
+ */
+static inline void block_absorb(block_header_t *block, block_header_t *next) {
+    size_t both = block->size_flags & next->size_flags & (BLOCK_PURGED | BLOCK_ZEROED);
+    block_set_size(block, block_size(block) + HEADER_SIZE + block_size(next));
+    block->size_flags = (block->size_flags & ~(BLOCK_PURGED | BLOCK_ZEROED)) | both;
+
+    if (both & BLOCK_ZEROED) memset((char *)next - FOOTER_SIZE, 0, FOOTER_SIZE + sizeof(block_header_t));
+}
+
+/**
+ * Locates the physical left neighbour through its footer. Only valid when BLOCK_PREV_FREE is set
+ */
+static inline block_header_t *block_prev(block_header_t *block) {
+    size_t prev_size = *(size_t *)((char *)block - FOOTER_SIZE);
+    return (block_header_t *)((char *)block - prev_size - HEADER_SIZE);
+}
+
+static inline void block_write_footer(block_header_t *block) {
+    *(size_t *)((char *)block + HEADER_SIZE + block_size(block) - FOOTER_SIZE) = block_size(block);
+}
+
+/**
+ * Formats fresh pages as one free block followed by the epilogue, region_size counts
+ * both headers. Returns the free block, which is not yet linked into any free list
+ */
+static inline block_header_t *block_format_region(void *region, size_t region_size) {
+    block_header_t *block = (block_header_t *)region;
+    // Fresh pages are not committed yet and read as zero
+    block->size_flags = (region_size - 2 * HEADER_SIZE) | BLOCK_FREE | BLOCK_PURGED | BLOCK_ZEROED;
+    block->next_free = NULL;
+    block->prev_free = NULL;
+    block_write_footer(block);
+
+    // Only the epilogue's header word exists, whatever follows it belongs to the region
+    block_header_t *epilogue = block_next(block);
+    epilogue->size_flags = BLOCK_PREV_FREE;
+
+    return block;
+}
+
+/**
+ * Called by a heap walk for each block with its payload, payload size and whether it is free
+ */
+typedef void (*block_visit_fn)(void *payload, size_t size, bool free, void *ctx);
+
+#endif
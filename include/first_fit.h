@@ -4,22 +4,29 @@
 #include <stddef.h>
 #include <stdbool.h>
 
-typedef struct block_header {
-    size_t size;
-    bool is_free;
+#include "list_fit.h"
+#include "strategy.h"
 
-    struct block_header *next_free;
-    struct block_header *prev_free;
-} block_header_t;
+typedef list_fit_heap_t first_fit_heap_t;
 
-#define HEADER_SIZE sizeof(block_header_t)
+int first_fit_init(first_fit_heap_t *heap, const region_config_t *config);
+void *first_fit_malloc(first_fit_heap_t *heap, size_t size);
+void *first_fit_memalign(first_fit_heap_t *heap, size_t alignment, size_t size);
+void *first_fit_resize(first_fit_heap_t *heap, void *ptr, size_t size);
+void first_fit_free(first_fit_heap_t *heap, void *ptr);
+size_t first_fit_malloc_batch(first_fit_heap_t *heap, size_t size, size_t count, void **out);
+void first_fit_free_batch(first_fit_heap_t *heap, void **ptrs, size_t count);
+void first_fit_purge(first_fit_heap_t *heap);
+void first_fit_destroy(first_fit_heap_t *heap);
 
-int first_fit_init(size_t initial_size);
-void *first_fit_malloc(size_t size);
-void first_fit_free(void *ptr);
+size_t first_fit_get_total_mapped_memory(first_fit_heap_t *heap);
+size_t first_fit_get_total_released_memory(first_fit_heap_t *heap);
+size_t first_fit_get_currently_allocated_memory(first_fit_heap_t *heap);
+size_t first_fit_get_structural_overhead(first_fit_heap_t *heap);
+void first_fit_get_stats(first_fit_heap_t *heap, strategy_stats_t *stats);
+bool first_fit_peek_stats(first_fit_heap_t *heap, strategy_stats_t *stats);
+region_list_t *first_fit_get_regions(first_fit_heap_t *heap);
 
-size_t first_fit_get_total_mapped_memory();
-size_t first_fit_get_currently_allocated_memory();
-size_t first_fit_get_structural_overhead();
+extern const strategy_ops_t first_fit_ops;
 
 #endif
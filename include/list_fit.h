@@ -0,0 +1,29 @@
+#ifndef LIST_FIT_H
+#define LIST_FIT_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "block.h"
+#include "region.h"
+#include "strategy.h"
+
+/**
+ * Heap of the strategies that keep all free blocks on one list: first, best and worst fit.
+ * They share the free list hooks of src/free_list.h and differ only in the block they pick
+ */
+typedef struct list_fit_heap {
+    block_header_t *free_list_head;
+
+    region_list_t regions;
+
+    // Stats
+    size_t currently_allocated;
+    size_t num_allocated;
+    free_stats_t free_stats;
+#ifdef TDMM_COUNTERS
+    tdmm_counters_t counters;
+#endif
+} list_fit_heap_t;
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef PAGE_MAP_H
+#define PAGE_MAP_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/**
+ * One bit for every page of the address space the allocator has mapped, regions and
+ * direct mappings alike. Only kept in TDMM_HARDENED builds, where t_free looks a pointer
+ * up here before it dares to read a header in front of it.
+ *
+ * A two level table: the top level is indexed by the GiB an address falls in, and
+ * points to a bitmap of that GiB's pages, mapped the first time one of them is set.
+ *
+ * A second table of the same shape keeps one live bit for every BLOCK_ALIGN granule,
+ * set while a block whose payload starts there is allocated. Every header sits right in
+ * front of an aligned payload, so this tells exactly which pointers may be freed
+ */
+#define PAGE_MAP_ADDRESS_BITS 48
+
+/**
+ * Sets or clears the bits of every page in [start, start + length), start page aligned.
+ * Clearing also drops the live bits of the blocks that were in those pages
+ */
+void page_map_set(void *start, size_t length, bool mapped);
+
+/**
+ * True if the page ptr lies in is mapped by the allocator. Constant time, lock-free
+ */
+bool page_map_contains(const void *ptr);
+
+/**
+ * Sets or clears the live bit of the block with this payload
+ */
+void page_map_set_live(const void *payload, bool live);
+
+/**
+ * Clears the live bit of the block with this payload and returns true if it was set.
+ * Of two racing claims only one sees it set
+ */
+bool page_map_claim(const void *payload);
+
+#endif
@@ -0,0 +1,175 @@
+#ifndef REGION_H
+#define REGION_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "block.h"
+
+/**
+ * Bookkeeping for one mmap'd region, stored in the last bytes of the mapping
+ * right after the epilogue header:
+ *
+ *   [ pad | block | block | ... | epilogue | region_t ]
+ *
+ * so the epilogue that ends a block run also leads to the region it belongs to.
+ * The pad of BLOCK_PAD bytes aligns the first payload.
+ */
+typedef struct region {
+    void *base;
+    size_t length;
+
+    struct region *next;
+    struct region *prev;
+} region_t;
+
+// The trailer is padded so the mapping ends on a block boundary
+#define REGION_TRAILER_SIZE ((sizeof(region_t) + BLOCK_ALIGN - 1) & ~(BLOCK_ALIGN - 1))
+// Bytes of every region not available to blocks: the pad, the epilogue and the trailer
+#define REGION_OVERHEAD (BLOCK_PAD + HEADER_SIZE + REGION_TRAILER_SIZE)
+
+typedef struct region_config {
+    size_t initial_size;  // Bytes mapped when a heap is initialized
+    size_t min_chunk;     // Smallest mapping, doubled on every mapping up to max_chunk
+    size_t max_chunk;     // Also caps merging, regions are released whole
+    size_t reserve_bytes; // Address space reserved up front and committed as the heap grows, 0 for none
+    size_t retain_bytes;  // Fully free regions are only unmapped while this much stays mapped
+
+    size_t purge_threshold;  // Free blocks at least this large get their pages purged, 0 disables purging
+    unsigned decay_ms;       // Free blocks stay committed this long before a purge, 0 purges on free
+    bool purge_lazy;         // MADV_FREE instead of MADV_DONTNEED, the kernel reclaims only under pressure
+} region_config_t;
+
+typedef struct region_list {
+    region_t *head;  // Lowest region, the list is kept in address order
+    region_config_t config;
+    size_t next_chunk;   // Minimum length of the next mapping
+
+    char *reserve_next;  // Start of the uncommitted part of the reserved range
+    char *reserve_end;
+
+    // Stats
+    size_t num_regions;
+    size_t total_mapped;    // Bytes currently mapped
+    size_t total_released;  // Bytes handed back with munmap over the heap's lifetime
+    size_t total_purged;    // Bytes handed back with madvise over the heap's lifetime
+
+    block_header_t *dirty_head;        // Free blocks waiting to be purged
+    unsigned long long next_purge_ms;  // Deadline of the next decay sweep
+    unsigned decay_ops;                // Frees since the clock was last read
+    unsigned char purge_epoch;         // Sweeps so far, blocks dirtied in the current epoch are spared
+} region_list_t;
+
+/**
+ * Links of the dirty list, in the payload words right after the free list links. Every free
+ * block of at least purge_threshold bytes that is not purged is on it, the threshold is
+ * raised to a page so the links and the footer always fit
+ */
+typedef struct dirty_links {
+    block_header_t *next;
+    block_header_t *prev;
+} dirty_links_t;
+
+void region_list_init(region_list_t *list, const region_config_t *config);
+
+/**
+ * Maps at least min_length bytes and returns them as one free block, not yet linked
+ * into any free list, or NULL. The pages either form a new region, extend an
+ * adjacent one or join the two around them, as long as the result stays within
+ * max_chunk. The block may border free blocks of those regions and must be
+ * coalesced like a freshly freed block
+ */
+block_header_t *region_map(region_list_t *list, size_t min_length);
+
+/**
+ * Unmaps the region if block is its only block and the retain threshold allows it.
+ * The caller must have unlinked block from its free lists. Returns true if unmapped
+ */
+bool region_try_release(region_list_t *list, block_header_t *block);
+
+/**
+ * Called on a just freed and coalesced block. If it is dirty and large enough, purges it
+ * right away or puts it on the dirty list. Every few frees, also sweeps the dirty list once
+ * the decay deadline has passed
+ */
+void region_note_free(region_list_t *list, block_header_t *block);
+
+/**
+ * Sweeps the dirty list if the decay deadline has passed, for the malloc slow path
+ */
+void region_decay(region_list_t *list);
+
+/**
+ * Purges the interior pages of every dirty free block above the threshold, regardless of decay
+ */
+void region_purge_all(region_list_t *list);
+
+/**
+ * Unmaps every region along with the blocks still in them, and the rest of the reserved range
+ */
+void region_list_destroy(region_list_t *list);
+
+/**
+ * Calls visit on every block of a region in address order, the epilogue excepted
+ */
+void region_walk(region_t *region, block_visit_fn visit, void *ctx);
+
+/**
+ * Returns the region a block's run ends in, given the epilogue that ends it
+ */
+static inline region_t *region_of_epilogue(block_header_t *epilogue) {
+    return (region_t *)((char *)epilogue + HEADER_SIZE);
+}
+
+static inline block_header_t *region_first_block(region_t *region) {
+    return (block_header_t *)((char *)region->base + BLOCK_PAD);
+}
+
+/**
+ * True if a free block covers its whole region, i.e. nothing in it is allocated
+ */
+static inline bool region_is_unused(block_header_t *block) {
+    // The right neighbour may be an allocated block, read it as in coalesce
+    size_t next_flags = block_flags(block_next(block));
+    return (next_flags & (BLOCK_SIZE_MASK | BLOCK_FREE)) == 0 &&
+           region_first_block(region_of_epilogue(block_next(block))) == block;
+}
+
+static inline dirty_links_t *dirty_links(block_header_t *block) {
+    return (dirty_links_t *)(block + 1);
+}
+
+static inline bool region_is_dirty(const region_list_t *list, const block_header_t *block) {
+    return list->config.purge_threshold != 0 && !block_has(block, BLOCK_PURGED) &&
+           block_size(block) >= list->config.purge_threshold;
+}
+
+static inline void dirty_push(region_list_t *list, block_header_t *block) {
+    dirty_links_t *links = dirty_links(block);
+    links->prev = NULL;
+    links->next = list->dirty_head;
+    if (list->dirty_head) dirty_links(list->dirty_head)->prev = block;
+    list->dirty_head = block;
+}
+
+/**
+ * Called before a free block leaves the free lists, takes it off the dirty list
+ */
+static inline void region_forget_free(region_list_t *list, block_header_t *block) {
+    if (!region_is_dirty(list, block)) return;
+
+    dirty_links_t *links = dirty_links(block);
+    if (links->prev) dirty_links(links->prev)->next = links->next;
+    else list->dirty_head = links->next;
+    if (links->next) dirty_links(links->next)->prev = links->prev;
+}
+
+/**
+ * Called on the free tail of a split block, which was taken off the dirty list with
+ * region_forget_free beforehand. The tail goes back on it with the epoch it inherited
+ */
+static inline void region_note_split(region_list_t *list, block_header_t *block) {
+    if (region_is_dirty(list, block)) dirty_push(list, block);
+}
+
+#endif
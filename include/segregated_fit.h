@@ -0,0 +1,53 @@
+#ifndef SEGREGATED_FIT_H
+#define SEGREGATED_FIT_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "block.h"
+#include "region.h"
+#include "strategy.h"
+
+// Blocks below 64 alignment units (1 KiB by default) get one exact-size bin
+// per unit, larger blocks are binned by power of two
+#define SEGREGATED_FIT_SMALL_BIN_COUNT 64
+#define SEGREGATED_FIT_LARGE_BIN_COUNT 56
+#define SEGREGATED_FIT_NUM_BINS (SEGREGATED_FIT_SMALL_BIN_COUNT + SEGREGATED_FIT_LARGE_BIN_COUNT)
+#define SEGREGATED_FIT_BITMAP_WORDS ((SEGREGATED_FIT_NUM_BINS + 63) / 64)
+typedef struct segregated_fit_heap {
+    block_header_t *bins[SEGREGATED_FIT_NUM_BINS];
+    uint64_t bin_bitmap[SEGREGATED_FIT_BITMAP_WORDS];
+
+    region_list_t regions;
+
+    // Stats
+    size_t currently_allocated;
+    size_t num_allocated;
+    free_stats_t free_stats;
+#ifdef TDMM_COUNTERS
+    tdmm_counters_t counters;
+#endif
+} segregated_fit_heap_t;
+
+int segregated_fit_init(segregated_fit_heap_t *heap, const region_config_t *config);
+void *segregated_fit_malloc(segregated_fit_heap_t *heap, size_t size);
+void *segregated_fit_memalign(segregated_fit_heap_t *heap, size_t alignment, size_t size);
+void *segregated_fit_resize(segregated_fit_heap_t *heap, void *ptr, size_t size);
+void segregated_fit_free(segregated_fit_heap_t *heap, void *ptr);
+size_t segregated_fit_malloc_batch(segregated_fit_heap_t *heap, size_t size, size_t count, void **out);
+void segregated_fit_free_batch(segregated_fit_heap_t *heap, void **ptrs, size_t count);
+void segregated_fit_purge(segregated_fit_heap_t *heap);
+void segregated_fit_destroy(segregated_fit_heap_t *heap);
+
+size_t segregated_fit_get_total_mapped_memory(segregated_fit_heap_t *heap);
+size_t segregated_fit_get_total_released_memory(segregated_fit_heap_t *heap);
+size_t segregated_fit_get_currently_allocated_memory(segregated_fit_heap_t *heap);
+size_t segregated_fit_get_structural_overhead(segregated_fit_heap_t *heap);
+void segregated_fit_get_stats(segregated_fit_heap_t *heap, strategy_stats_t *stats);
+bool segregated_fit_peek_stats(segregated_fit_heap_t *heap, strategy_stats_t *stats);
+region_list_t *segregated_fit_get_regions(segregated_fit_heap_t *heap);
+
+extern const strategy_ops_t segregated_fit_ops;
+
+#endif
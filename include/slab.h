@@ -0,0 +1,123 @@
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "block.h"
+
+// Objects up to SLAB_MAX_SIZE bytes are served from slabs, in classes of one granule.
+// Slots are granule aligned, so the granule is at least BLOCK_ALIGN
+#define SLAB_MAX_SIZE 256
+#define SLAB_GRANULE (BLOCK_ALIGN > 16 ? BLOCK_ALIGN : 16)
+#define SLAB_NUM_CLASSES (SLAB_MAX_SIZE / SLAB_GRANULE)
+
+// Slabs are naturally aligned, so an object finds its slab by masking its address
+#define SLAB_SIZE (16 * 1024)
+// Address space reserved for all slabs, pages are only committed when touched
+#define SLAB_RESERVE_BYTES ((size_t)1 << 30)
+// Upper bound on the slots of a slab
+#define SLAB_MAX_SLOTS (SLAB_SIZE / SLAB_GRANULE)
+
+/**
+ * Header at the start of every slab. The rest of the slab is carved into equal
+ * slots of one size class, which carry no header of their own:
+ *
+ *   [ slab_t | slot | slot | ... | slot ]
+ *
+ * Free slots are threaded through their first word.
+ */
+typedef struct slab {
+    struct slab *next;  // Partial or empty list of the owning cache
+    struct slab *prev;
+
+    void *free_list;    // Slots freed since the slab was carved
+    char *bump;         // Slots past this were never handed out
+    unsigned used;
+    unsigned capacity;
+    unsigned short slot_size;
+    unsigned char class_idx;
+    unsigned char arena;  // Owning arena, like block_header_t.arena
+
+#ifdef TDMM_HARDENED
+    uint64_t live[SLAB_MAX_SLOTS / 64];  // One bit per slot handed out and not freed since
+#endif
+} slab_t;
+
+// Slots start after the header, kept SLAB_GRANULE aligned
+#define SLAB_HEADER_SIZE ((sizeof(slab_t) + SLAB_GRANULE - 1) & ~(size_t)(SLAB_GRANULE - 1))
+
+/**
+ * The slabs of one arena
+ */
+typedef struct slab_cache {
+    slab_t *partial[SLAB_NUM_CLASSES];  // Slabs with at least one free slot, full slabs are on no list
+    slab_t *empty;                      // Fully free slabs, reusable by any class
+    unsigned char arena;
+
+    // Stats
+    size_t num_slabs;
+    size_t currently_allocated;
+    size_t num_allocated;
+} slab_cache_t;
+
+typedef struct slab_reservation {
+    char *base;
+    char *end;
+    char *next;  // Next slab to carve, bumped atomically since all arenas share the range
+} slab_reservation_t;
+
+extern slab_reservation_t slab_reservation;
+
+/**
+ * Reserves the slab address range on first use and forgets every slab carved so far.
+ * Returns -1 if the range can't be reserved, slabs are then never used
+ */
+int slab_reset();
+
+void slab_cache_init(slab_cache_t *cache, unsigned char arena);
+
+/**
+ * Returns a slot of at least size bytes, size must not exceed SLAB_MAX_SIZE.
+ * Returns NULL once the reservation is exhausted
+ */
+void *slab_malloc(slab_cache_t *cache, size_t size);
+void slab_free(slab_cache_t *cache, void *ptr);
+
+#ifdef TDMM_HARDENED
+/**
+ * Marks a slot as handed out again, for slots that were parked in a thread cache
+ */
+void slab_mark_live(void *ptr);
+
+/**
+ * Marks a live slot as freed. Returns false, changing nothing, if ptr is not the
+ * start of a slot or the slot is not live. Atomic, so of two racing frees one fails
+ */
+bool slab_claim(void *ptr);
+#endif
+
+/**
+ * Calls visit on every slot carved from a slab so far, in address order. Slots parked
+ * in a thread cache count as allocated. Caller holds the lock of the slab's arena
+ */
+void slab_walk(slab_t *slab, block_visit_fn visit, void *ctx);
+
+size_t slab_get_total_mapped_memory(slab_cache_t *cache);
+size_t slab_get_currently_allocated_memory(slab_cache_t *cache);
+size_t slab_get_num_allocated(slab_cache_t *cache);
+size_t slab_get_structural_overhead(slab_cache_t *cache);
+
+/**
+ * True if ptr was handed out by a slab. Must be checked before reading a block header
+ */
+static inline bool slab_contains(const void *ptr) {
+    return (uintptr_t)ptr - (uintptr_t)slab_reservation.base < (uintptr_t)(slab_reservation.end - slab_reservation.base);
+}
+
+static inline slab_t *slab_of(const void *ptr) {
+    return (slab_t *)((uintptr_t)ptr & ~(uintptr_t)(SLAB_SIZE - 1));
+}
+
+#endif
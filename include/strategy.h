@@ -0,0 +1,159 @@
+#ifndef STRATEGY_H
+#define STRATEGY_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "region.h"
+#include "tdmm.h"
+
+// Free blocks are counted by the power of two below their size, bucket i holds
+// sizes in [2^i, 2^(i+1)). Block sizes stay below BLOCK_ZEROED = 2^47
+#define FREE_STATS_BUCKETS 47
+
+/**
+ * Running totals over a heap's free lists, updated wherever a block enters or leaves
+ * them so the stats never walk a list. largest_free is exact until the largest block
+ * leaves the lists whole, then only an upper bound until the strategy looks it up again.
+ * Splitting the largest block keeps it exact as long as the remainder is alone in the
+ * highest non-empty histogram bucket
+ */
+typedef struct free_stats {
+    size_t num_free;
+    size_t free_bytes;    // Payload bytes of the free blocks
+    size_t largest_free;
+    bool largest_stale;
+    size_t histogram[FREE_STATS_BUCKETS];
+} free_stats_t;
+
+static inline size_t free_stats_bucket(size_t size) {
+    return (sizeof(size_t) * 8 - 1) - __builtin_clzl(size);
+}
+
+static inline void free_stats_init(free_stats_t *stats) {
+    stats->num_free = 0;
+    stats->free_bytes = 0;
+    stats->largest_free = 0;
+    stats->largest_stale = false;
+    memset(stats->histogram, 0, sizeof(stats->histogram));
+}
+
+static inline void free_stats_add(free_stats_t *stats, size_t size) {
+    STAT_ADD(stats->num_free, 1);
+    STAT_ADD(stats->free_bytes, size);
+    stats->histogram[free_stats_bucket(size)]++;
+    // At least as large as the bound, so it is the largest block for certain
+    if (size >= stats->largest_free) {
+        STAT_SET(stats->largest_free, size);
+        STAT_SET(stats->largest_stale, false);
+    }
+}
+
+static inline void free_stats_remove(free_stats_t *stats, size_t size) {
+    STAT_SUB(stats->num_free, 1);
+    STAT_SUB(stats->free_bytes, size);
+    stats->histogram[free_stats_bucket(size)]--;
+    if (size == stats->largest_free) STAT_SET(stats->largest_stale, true);
+}
+
+/**
+ * Replaces a free block by the tail split off it. The tail is the new largest block if the
+ * old one was the largest and no other block is left in the tail's bucket or above it.
+ * Takes at most one step per bucket
+ */
+static inline void free_stats_split(free_stats_t *stats, size_t old_size, size_t new_size) {
+    bool was_largest = old_size == stats->largest_free && !stats->largest_stale;
+    free_stats_remove(stats, old_size);
+    free_stats_add(stats, new_size);
+    if (!was_largest || !stats->largest_stale) return;
+
+    size_t bucket = free_stats_bucket(new_size);
+    if (stats->histogram[bucket] != 1) return;
+    for (size_t above = free_stats_bucket(old_size); above > bucket; above--) {
+        if (stats->histogram[above] != 0) return;
+    }
+    STAT_SET(stats->largest_free, new_size);
+    STAT_SET(stats->largest_stale, false);
+}
+
+/**
+ * Hot-path events are counted into the tdmm_counters_t of the heap, in builds configured
+ * with TDMM_COUNTERS. A heap is only touched under its arena's lock, so the counters need
+ * no atomics and share cache lines only with the free lists the arena's threads write anyway
+ */
+#ifdef TDMM_COUNTERS
+#define COUNTER_ADD(heap, counter, n) ((heap)->counters.counter += (n))
+#else
+// n is named but never evaluated, so disabled counters cost nothing and leave no unused variables
+#define COUNTER_ADD(heap, counter, n) ((void)sizeof(n))
+#endif
+
+/**
+ * Snapshot of a heap's block counts, filled in by the strategy's get_stats
+ */
+typedef struct strategy_stats {
+    size_t num_allocated;
+    size_t num_free;
+    size_t free_bytes;
+    size_t largest_free;
+    size_t free_histogram[FREE_STATS_BUCKETS];  // As free_stats_t.histogram
+#ifdef TDMM_COUNTERS
+    tdmm_counters_t counters;
+#endif
+} strategy_stats_t;
+
+/**
+ * The operations every strategy provides, on a heap of the strategy's own type.
+ * tdmm.c picks a table once when an arena is initialized instead of branching
+ * on the strategy in every call
+ */
+typedef struct strategy_ops {
+    int (*init)(void *heap, const region_config_t *config);
+    void *(*memalign)(void *heap, size_t alignment, size_t size);
+    void *(*resize)(void *heap, void *ptr, size_t size);
+    void (*free)(void *heap, void *ptr);
+    size_t (*malloc_batch)(void *heap, size_t size, size_t count, void **out);
+    void (*free_batch)(void *heap, void **ptrs, size_t count);
+    void (*purge)(void *heap);
+    void (*destroy)(void *heap);
+
+    size_t (*get_total_mapped_memory)(void *heap);
+    size_t (*get_total_released_memory)(void *heap);
+    size_t (*get_currently_allocated_memory)(void *heap);
+    size_t (*get_structural_overhead)(void *heap);
+    void (*get_stats)(void *heap, strategy_stats_t *stats);
+    bool (*peek_stats)(void *heap, strategy_stats_t *stats);
+    region_list_t *(*get_regions)(void *heap);
+} strategy_ops_t;
+
+/**
+ * Defines prefix_ops from the prefix_* functions of a strategy. The thunks only
+ * convert the heap pointer, calling the functions through void * would be undefined
+ */
+#define STRATEGY_DEFINE_OPS(prefix) STRATEGY_DEFINE_OPS_(prefix)
+#define STRATEGY_DEFINE_OPS_(prefix) \
+    static int prefix##_ops_init(void *heap, const region_config_t *config) { return prefix##_init(heap, config); } \
+    static void *prefix##_ops_memalign(void *heap, size_t alignment, size_t size) { return prefix##_memalign(heap, alignment, size); } \
+    static void *prefix##_ops_resize(void *heap, void *ptr, size_t size) { return prefix##_resize(heap, ptr, size); } \
+    static void prefix##_ops_free(void *heap, void *ptr) { prefix##_free(heap, ptr); } \
+    static size_t prefix##_ops_malloc_batch(void *heap, size_t size, size_t count, void **out) { return prefix##_malloc_batch(heap, size, count, out); } \
+    static void prefix##_ops_free_batch(void *heap, void **ptrs, size_t count) { prefix##_free_batch(heap, ptrs, count); } \
+    static void prefix##_ops_purge(void *heap) { prefix##_purge(heap); } \
+    static void prefix##_ops_destroy(void *heap) { prefix##_destroy(heap); } \
+    static size_t prefix##_ops_get_total_mapped_memory(void *heap) { return prefix##_get_total_mapped_memory(heap); } \
+    static size_t prefix##_ops_get_total_released_memory(void *heap) { return prefix##_get_total_released_memory(heap); } \
+    static size_t prefix##_ops_get_currently_allocated_memory(void *heap) { return prefix##_get_currently_allocated_memory(heap); } \
+    static size_t prefix##_ops_get_structural_overhead(void *heap) { return prefix##_get_structural_overhead(heap); } \
+    static void prefix##_ops_get_stats(void *heap, strategy_stats_t *stats) { prefix##_get_stats(heap, stats); } \
+    static bool prefix##_ops_peek_stats(void *heap, strategy_stats_t *stats) { return prefix##_peek_stats(heap, stats); } \
+    static region_list_t *prefix##_ops_get_regions(void *heap) { return prefix##_get_regions(heap); } \
+    const strategy_ops_t prefix##_ops = { \
+        prefix##_ops_init, prefix##_ops_memalign, prefix##_ops_resize, prefix##_ops_free, \
+        prefix##_ops_malloc_batch, prefix##_ops_free_batch, prefix##_ops_purge, prefix##_ops_destroy, \
+        prefix##_ops_get_total_mapped_memory, prefix##_ops_get_total_released_memory, \
+        prefix##_ops_get_currently_allocated_memory, prefix##_ops_get_structural_overhead, \
+        prefix##_ops_get_stats, prefix##_ops_peek_stats, prefix##_ops_get_regions, \
+    }
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef TLSF_H
+#define TLSF_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "block.h"
+#include "region.h"
+#include "strategy.h"
+
+// Each power of two (first level) is split into TLSF_SL_INDEX_COUNT linear ranges (second level)
+#define TLSF_SL_INDEX_COUNT_LOG2 4
+#define TLSF_SL_INDEX_COUNT (1 << TLSF_SL_INDEX_COUNT_LOG2)
+// log2(BLOCK_ALIGN): payload sizes step by BLOCK_ALIGN, so the second level lists of
+// first level 0 must be that fine to hold a single size each
+#define TLSF_ALIGN_SIZE_LOG2 (BLOCK_ALIGN == 8 ? 3 : BLOCK_ALIGN == 16 ? 4 : BLOCK_ALIGN == 32 ? 5 : \
+                              BLOCK_ALIGN == 64 ? 6 : BLOCK_ALIGN == 128 ? 7 : 8)
+#define TLSF_FL_INDEX_SHIFT (TLSF_SL_INDEX_COUNT_LOG2 + TLSF_ALIGN_SIZE_LOG2)
+#define TLSF_FL_INDEX_MAX 63
+#define TLSF_FL_INDEX_COUNT (TLSF_FL_INDEX_MAX - TLSF_FL_INDEX_SHIFT + 1)
+typedef struct tlsf_heap {
+    block_header_t *blocks[TLSF_FL_INDEX_COUNT][TLSF_SL_INDEX_COUNT];
+    uint64_t fl_bitmap;
+    uint32_t sl_bitmap[TLSF_FL_INDEX_COUNT];
+
+    region_list_t regions;
+
+    // Stats
+    size_t currently_allocated;
+    size_t num_allocated;
+    free_stats_t free_stats;
+#ifdef TDMM_COUNTERS
+    tdmm_counters_t counters;
+#endif
+} tlsf_heap_t;
+
+int tlsf_init(tlsf_heap_t *heap, const region_config_t *config);
+void *tlsf_malloc(tlsf_heap_t *heap, size_t size);
+void *tlsf_memalign(tlsf_heap_t *heap, size_t alignment, size_t size);
+void *tlsf_resize(tlsf_heap_t *heap, void *ptr, size_t size);
+void tlsf_free(tlsf_heap_t *heap, void *ptr);
+size_t tlsf_malloc_batch(tlsf_heap_t *heap, size_t size, size_t count, void **out);
+void tlsf_free_batch(tlsf_heap_t *heap, void **ptrs, size_t count);
+void tlsf_purge(tlsf_heap_t *heap);
+void tlsf_destroy(tlsf_heap_t *heap);
+
+size_t tlsf_get_total_mapped_memory(tlsf_heap_t *heap);
+size_t tlsf_get_total_released_memory(tlsf_heap_t *heap);
+size_t tlsf_get_currently_allocated_memory(tlsf_heap_t *heap);
+size_t tlsf_get_structural_overhead(tlsf_heap_t *heap);
+void tlsf_get_stats(tlsf_heap_t *heap, strategy_stats_t *stats);
+bool tlsf_peek_stats(tlsf_heap_t *heap, strategy_stats_t *stats);
+region_list_t *tlsf_get_regions(tlsf_heap_t *heap);
+
+extern const strategy_ops_t tlsf_ops;
+
+#endif
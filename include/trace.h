@@ -0,0 +1,73 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Binary format of an allocation trace, written by t_trace_start in TDMM_TRACE builds
+ * and read back by hw6_replay. A header is followed by fixed-size events in the order
+ * they were logged, in host byte order:
+ *
+ *   [ trace_header_t | trace_event_t | trace_event_t | ... ]
+ *
+ * Blocks are named by the address the traced program got, the replay maps them to its own.
+ * Allocations are logged once they returned and frees before the block is let go, so an
+ * address is always freed in the trace before another thread's malloc can hand it out again.
+ * Only a realloc that moves its block frees the old one before it is logged, another thread
+ * may then show up with that address first
+ */
+#define TRACE_MAGIC "TDMMTRC"
+#define TRACE_VERSION 1
+
+typedef struct trace_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t event_size;  // sizeof(trace_event_t), so a reader can reject a mismatched layout
+} trace_header_t;
+
+typedef enum {
+    TRACE_MALLOC = 1,
+    TRACE_CALLOC,
+    TRACE_ALIGNED,
+    TRACE_REALLOC,
+    TRACE_FREE,
+} trace_op_e;
+
+// The op shares a word with the size, no request comes close to 2^56 bytes
+#define TRACE_OP_SHIFT 56
+#define TRACE_SIZE_MASK (((uint64_t)1 << TRACE_OP_SHIFT) - 1)
+
+typedef struct trace_event {
+    uint64_t time_ns;  // Since t_trace_start
+    uint64_t ptr;      // Block returned, 0 if the allocation failed. The block freed for TRACE_FREE
+    uint64_t arg;      // Block passed to realloc, alignment of an aligned allocation, otherwise 0
+    uint64_t op_size;  // Op in the top byte, size requested below it
+} trace_event_t;
+
+static inline trace_op_e trace_event_op(const trace_event_t *event) {
+    return (trace_op_e)(event->op_size >> TRACE_OP_SHIFT);
+}
+
+static inline size_t trace_event_size(const trace_event_t *event) {
+    return (size_t)(event->op_size & TRACE_SIZE_MASK);
+}
+
+/**
+ * Creates the trace file at path and starts logging. Returns -1 if it can't be created
+ * or a trace is already being written
+ */
+int trace_open(const char *path);
+
+/**
+ * Flushes the remaining events and closes the trace. Does nothing if none is open
+ */
+void trace_close();
+
+/**
+ * Appends an event if a trace is open. Callable from any thread, events are buffered
+ * and written in batches
+ */
+void trace_log(trace_op_e op, const void *ptr, uintptr_t arg, size_t size);
+
+#endif
@@ -4,22 +4,29 @@
 #include <stddef.h>
 #include <stdbool.h>
 
-typedef struct worst_fit_block_header {
-    size_t size;
-    bool is_free;
+#include "list_fit.h"
+#include "strategy.h"
 
-    struct worst_fit_block_header *next_free;
-    struct worst_fit_block_header *prev_free;
-} worst_fit_block_header_t;
+typedef list_fit_heap_t worst_fit_heap_t;
 
-#define WORST_FIT_HEADER_SIZE sizeof(worst_fit_block_header_t)
+int worst_fit_init(worst_fit_heap_t *heap, const region_config_t *config);
+void *worst_fit_malloc(worst_fit_heap_t *heap, size_t size);
+void *worst_fit_memalign(worst_fit_heap_t *heap, size_t alignment, size_t size);
+void *worst_fit_resize(worst_fit_heap_t *heap, void *ptr, size_t size);
+void worst_fit_free(worst_fit_heap_t *heap, void *ptr);
+size_t worst_fit_malloc_batch(worst_fit_heap_t *heap, size_t size, size_t count, void **out);
+void worst_fit_free_batch(worst_fit_heap_t *heap, void **ptrs, size_t count);
+void worst_fit_purge(worst_fit_heap_t *heap);
+void worst_fit_destroy(worst_fit_heap_t *heap);
 
-int worst_fit_init(size_t initial_size);
-void* worst_fit_malloc(size_t size);
-void worst_fit_free(void *ptr);
+size_t worst_fit_get_total_mapped_memory(worst_fit_heap_t *heap);
+size_t worst_fit_get_total_released_memory(worst_fit_heap_t *heap);
+size_t worst_fit_get_currently_allocated_memory(worst_fit_heap_t *heap);
+size_t worst_fit_get_structural_overhead(worst_fit_heap_t *heap);
+void worst_fit_get_stats(worst_fit_heap_t *heap, strategy_stats_t *stats);
+bool worst_fit_peek_stats(worst_fit_heap_t *heap, strategy_stats_t *stats);
+region_list_t *worst_fit_get_regions(worst_fit_heap_t *heap);
 
-size_t worst_fit_get_total_mapped_memory();
-size_t worst_fit_get_currently_allocated_memory();
-size_t worst_fit_get_structural_overhead();
+extern const strategy_ops_t worst_fit_ops;
 
-#endif
\ No newline at end of file
+#endif
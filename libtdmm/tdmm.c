@@ -1,48 +1,1736 @@
+// mremap
+#define _GNU_SOURCE
 #include "tdmm.h"
 #include "first_fit.h"
 #include "best_fit.h"
 #include "worst_fit.h"
+#include "segregated_fit.h"
+#include "tlsf.h"
+#include "slab.h"
+#include "page_map.h"
+#include "trace.h"
 
-static alloc_strat_e current_strat;
+#include <sys/mman.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef TDMM_THREAD_SAFE
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Upper bound on arenas, block headers store the owning arena in a byte
+#define MAX_ARENAS 32
+
+// Arenas start with 16 pages and grow geometrically from there, so a run of
+// misses costs a logarithmic number of mmaps
+#define DEFAULT_INITIAL_SIZE (16 * 4096)
+#define DEFAULT_MIN_CHUNK (16 * 4096)
+#define DEFAULT_MAX_CHUNK (1024 * 1024)
+#define PAGE_SIZE 4096
+
+// Requests this large get a mapping of their own, like glibc's M_MMAP_THRESHOLD
+#define DEFAULT_MMAP_THRESHOLD (128 * 1024)
+// Arena byte of blocks that live in a mapping of their own instead of an arena
+#define DIRECT_ARENA UCHAR_MAX
+
+// Recycled blocks at least this large are cleared with non-temporal stores by t_calloc
+#define CALLOC_STREAM_THRESHOLD (256 * 1024)
+
+// Keep up to 64 pages of fully free regions mapped before unmapping any
+#define DEFAULT_RETAIN_BYTES (64 * 4096)
+// Purge free blocks of 16 pages or more once they have been free for about a second
+#define DEFAULT_PURGE_THRESHOLD (16 * 4096)
+#define DEFAULT_DECAY_MS 1000
+
+// Bump arenas map chunks of 16 pages unless created with another size. Requests over a
+// quarter of a chunk get a chunk of their own, so at most a quarter of a chunk is skipped
+#define DEFAULT_BUMP_CHUNK (16 * 4096)
+#define BUMP_OWN_CHUNK_DIVISOR 4
+
+typedef struct remote_free {
+    struct remote_free *next;
+    size_t footprint;  // As tcache_entry_t.footprint
+} remote_free_t;
+
+/**
+ * An independent heap: its own mapped regions, free lists and stats.
+ * Threads are bound to one arena and allocate only from it
+ */
+typedef struct heap_arena {
+    union {
+        first_fit_heap_t first_fit;
+        best_fit_heap_t best_fit;
+        worst_fit_heap_t worst_fit;
+        segregated_fit_heap_t segregated_fit;
+        tlsf_heap_t tlsf;
+    } heap;
+    const strategy_ops_t *ops;  // Functions of the strategy that runs heap
+    slab_cache_t slabs;    // Small objects, in front of the strategy
+    size_t slab_max_size;  // Largest request served from the slabs, 0 if they are not used
+    unsigned char index;
+    bool initialized;
+
+#ifdef TDMM_THREAD_SAFE
+    pthread_mutex_t lock;
+    // Blocks freed by threads bound to other arenas, drained by the owner under its lock
+    remote_free_t *remote_free_head;
+    // Footprint and number of the blocks on the stack, still allocated as far as the heap knows
+    size_t remote_free_bytes;
+    size_t remote_free_count;
+#endif
+} heap_arena_t;
+
+static region_config_t region_config;
+
+#ifdef TDMM_STRATEGY
+// Only this strategy is linked, arenas call it directly and need no table
+#define STRATEGY_NAME(prefix, name) STRATEGY_NAME_(prefix, name)
+#define STRATEGY_NAME_(prefix, name) prefix##_##name
+#define STRATEGY_CALL(arena, fn, ...) STRATEGY_NAME(TDMM_STRATEGY, fn)((void *)&(arena)->heap, ##__VA_ARGS__)
+#else
+#define STRATEGY_CALL(arena, fn, ...) (arena)->ops->fn(&(arena)->heap, ##__VA_ARGS__)
+#endif
+
+// Calls of the public API are logged while a trace is open, see trace.h
+#ifdef TDMM_TRACE
+#define TRACE_LOG(op, ptr, arg, size) trace_log(op, ptr, arg, size)
+#else
+#define TRACE_LOG(op, ptr, arg, size)
+#endif
+
+/**
+ * Returns the table arenas of a strategy dispatch through, looked up once per heap, or NULL
+ * if the strategy isn't linked
+ */
+static const strategy_ops_t *strategy_ops(alloc_strat_e strat) {
+#ifdef TDMM_STRATEGY
+    if (strat != TDMM_STRATEGY_ENUM) return NULL;
+    return &STRATEGY_NAME(TDMM_STRATEGY, ops);
+#else
+    if (strat == BEST_FIT) return &best_fit_ops;
+    if (strat == WORST_FIT) return &worst_fit_ops;
+    if (strat == SEGREGATED_FIT) return &segregated_fit_ops;
+    if (strat == TLSF) return &tlsf_ops;
+    return &first_fit_ops;
+#endif
+}
+static heap_arena_t arenas[MAX_ARENAS];
+static unsigned num_arenas = 1;
+
+static size_t mmap_threshold = SIZE_MAX;
+static size_t slab_max_size = 0;
+
+// Stats of direct mappings, updated atomically since they are not behind any arena lock
+static size_t direct_mapped;
+static size_t direct_released;
+static size_t direct_count;
+
+/**
+ * Links a live direct mapping to the others, so t_init can unmap the previous heap's.
+ * It sits at the start of the mapping, in front of the block header
+ */
+typedef struct direct_link {
+    struct direct_link *next;
+    struct direct_link *prev;
+    size_t length;
+} direct_link_t;
+
+// Bytes in front of the payload of a direct mapping aligned to BLOCK_ALIGN
+#define DIRECT_PAD ((sizeof(direct_link_t) + HEADER_SIZE + BLOCK_ALIGN - 1) & ~(size_t)(BLOCK_ALIGN - 1))
+
+// Circular, the list is empty when the sentinel links to itself
+static direct_link_t direct_list = {&direct_list, &direct_list, 0};
+
+#ifdef TDMM_THREAD_SAFE
+// Only guards direct_list, mapping and unmapping happen outside of it except for mremap
+static pthread_mutex_t direct_list_mutex = PTHREAD_MUTEX_INITIALIZER;
+#define direct_list_lock() pthread_mutex_lock(&direct_list_mutex)
+#define direct_list_unlock() pthread_mutex_unlock(&direct_list_mutex)
+#else
+#define direct_list_lock() ((void)0)
+#define direct_list_unlock() ((void)0)
+#endif
+
+// Stats of bump arena chunks, which outlive t_init and so are kept apart from direct mappings
+static size_t bump_mapped;
+static size_t bump_released;
+
+/**
+ * Tags a block the moment it is handed out with its owner and, when hardened, sets its live bit
+ */
+static void block_stamp(block_header_t *header, unsigned char arena) {
+    block_set_owner(header, arena);
+#ifdef TDMM_HARDENED
+    page_map_set_live((char *)header + HEADER_SIZE, true);
+#endif
+}
+
+/**
+ * Maps a block of its own for a huge request. It never enters an arena, so it
+ * can't fragment the free lists and goes straight back to the OS on free.
+ * The header always sits in the first page of the mapping, its size runs to the end
+ */
+static void *direct_malloc(size_t alignment, size_t size) {
+    // Alignments above a page map extra address space and trim it off again
+    size_t offset = alignment > PAGE_SIZE ? PAGE_SIZE :
+                    (sizeof(direct_link_t) + HEADER_SIZE + alignment - 1) & ~(alignment - 1);
+    size_t slack = alignment > PAGE_SIZE ? alignment - PAGE_SIZE : 0;
+    if (size > SIZE_MAX - offset - slack - PAGE_SIZE) return NULL;
+    size_t length = (size + offset + PAGE_SIZE - 1) & ~(size_t)(PAGE_SIZE - 1);
+
+    char *mapped = mmap(NULL, length + slack, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (mapped == MAP_FAILED) return NULL;
+
+    char *base = mapped;
+    if (slack > 0) {
+        base = (char *)(((uintptr_t)mapped + offset + alignment - 1) & ~(uintptr_t)(alignment - 1)) - offset;
+        if (base > mapped) munmap(mapped, (size_t)(base - mapped));
+        if (mapped + slack > base) munmap(base + length, (size_t)(mapped + slack - base));
+    }
+
+    block_header_t *header = (block_header_t *)(base + offset - HEADER_SIZE);
+    header->size_flags = length - offset;
+    block_stamp(header, DIRECT_ARENA);
+#ifdef TDMM_HARDENED
+    page_map_set(base, length, true);
+#endif
+
+    direct_link_t *link = (direct_link_t *)base;
+    link->length = length;
+    direct_list_lock();
+    link->prev = &direct_list;
+    link->next = direct_list.next;
+    link->next->prev = link;
+    direct_list.next = link;
+    direct_list_unlock();
+
+    __atomic_add_fetch(&direct_mapped, length, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&direct_count, 1, __ATOMIC_RELAXED);
+
+    return base + offset;
+}
+
+static void direct_free(block_header_t *header) {
+    direct_link_t *link = (direct_link_t *)((uintptr_t)header & ~(uintptr_t)(PAGE_SIZE - 1));
+    size_t length = link->length;
+    direct_list_lock();
+    link->prev->next = link->next;
+    link->next->prev = link->prev;
+    direct_list_unlock();
+
+    char *base = (char *)link;
+    if (munmap(base, length) != 0) return;
+#ifdef TDMM_HARDENED
+    page_map_set(base, length, false);
+#endif
+
+    __atomic_sub_fetch(&direct_mapped, length, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&direct_released, length, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&direct_count, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * Unmaps the direct mappings still live when t_init replaces the heap
+ */
+static void direct_unmap_all() {
+    direct_list_lock();
+    direct_link_t *link = direct_list.next;
+    while (link != &direct_list) {
+        direct_link_t *next = link->next;
+        size_t length = link->length;
+        munmap(link, length);
+#ifdef TDMM_HARDENED
+        page_map_set(link, length, false);
+#endif
+        link = next;
+    }
+    direct_list.next = &direct_list;
+    direct_list.prev = &direct_list;
+    direct_list_unlock();
+}
+
+/**
+ * Resizes a direct mapping with mremap, which moves the pages instead of copying them
+ */
+static void *direct_realloc(block_header_t *header, size_t size) {
+    char *base = (char *)((uintptr_t)header & ~(uintptr_t)(PAGE_SIZE - 1));
+    size_t offset = (size_t)((char *)header + HEADER_SIZE - base);
+    size_t old_length = offset + block_size(header);
+    if (size > SIZE_MAX - offset - PAGE_SIZE) return NULL;
+    size_t length = (size + offset + PAGE_SIZE - 1) & ~(size_t)(PAGE_SIZE - 1);
+    if (length == old_length) return base + offset;
+
+    // The neighbours on direct_list point at the link, which may move with the pages
+    direct_list_lock();
+    char *moved = mremap(base, old_length, length, MREMAP_MAYMOVE);
+    if (moved == MAP_FAILED) {
+        direct_list_unlock();
+        return NULL;
+    }
+    direct_link_t *link = (direct_link_t *)moved;
+    link->length = length;
+    link->prev->next = link;
+    link->next->prev = link;
+    direct_list_unlock();
+
+    header = (block_header_t *)(moved + offset - HEADER_SIZE);
+    block_set_size(header, length - offset);
+#ifdef TDMM_HARDENED
+    // Unmapping the old pages drops the old live bit, the block is stamped again where it landed
+    page_map_set(base, old_length, false);
+    page_map_set(moved, length, true);
+    block_stamp(header, DIRECT_ARENA);
+#endif
+
+    if (length > old_length) {
+        __atomic_add_fetch(&direct_mapped, length - old_length, __ATOMIC_RELAXED);
+    }
+    else {
+        __atomic_sub_fetch(&direct_mapped, old_length - length, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&direct_released, old_length - length, __ATOMIC_RELAXED);
+    }
+
+    return moved + offset;
+}
+
+/**
+ * Clears memory for t_calloc. Large blocks bypass the cache, clearing them would
+ * otherwise evict the caller's working set for lines it may not touch again soon
+ */
+static void zero_fill(void *ptr, size_t size) {
+#ifdef __SSE2__
+    if (size >= CALLOC_STREAM_THRESHOLD) {
+        char *curr = (char *)ptr;
+        char *end = curr + size;
+        char *line = (char *)(((uintptr_t)curr + 63) & ~(uintptr_t)63);
+        memset(curr, 0, (size_t)(line - curr));
+
+        __m128i zero = _mm_setzero_si128();
+        for (; line + 64 <= end; line += 64) {
+            _mm_stream_si128((__m128i *)line, zero);
+            _mm_stream_si128((__m128i *)(line + 16), zero);
+            _mm_stream_si128((__m128i *)(line + 32), zero);
+            _mm_stream_si128((__m128i *)(line + 48), zero);
+        }
+        _mm_sfence();
+
+        memset(line, 0, (size_t)(end - line));
+        return;
+    }
+#endif
+    memset(ptr, 0, size);
+}
+
+/**
+ * Returns the arena a block (slab slot or strategy block) belongs to, or DIRECT_ARENA
+ */
+static unsigned char block_arena(void *ptr) {
+    if (slab_contains(ptr)) return slab_of(ptr)->arena;
+    return block_owner((block_header_t *)((char *)ptr - HEADER_SIZE));
+}
+
+/**
+ * Returns the bytes a block can hold
+ */
+static size_t block_usable_size(void *ptr) {
+    if (slab_contains(ptr)) return slab_of(ptr)->slot_size;
+    return block_flags((block_header_t *)((char *)ptr - HEADER_SIZE)) & BLOCK_SIZE_MASK;
+}
+
+#ifdef TDMM_HARDENED
+/**
+ * Checks in constant time that ptr is an allocated block and marks it freed. A slot is
+ * checked against its slab's bitmap. Any other pointer must lie in pages the allocator
+ * mapped and have its live bit set in the page map, which no header is read for. Reports
+ * the pointer and returns false if it can't be freed
+ */
+static bool free_claim(void *ptr) {
+    if (slab_contains(ptr)) {
+        if (slab_claim(ptr)) return true;
+    }
+    else if ((uintptr_t)ptr % BLOCK_ALIGN == 0 && page_map_contains((char *)ptr - HEADER_SIZE)) {
+        // Clearing the live bit is the claim, of two racing frees only one succeeds
+        if (page_map_claim(ptr)) return true;
+    }
+    else {
+        fprintf(stderr, "Error: free of %p, which the allocator never handed out\n", ptr);
+        return false;
+    }
+
+    fprintf(stderr, "Error: free of %p, which is not an allocated block (double free?)\n", ptr);
+    return false;
+}
+#endif
+
+/**
+ * Allocates from an arena, alignment is a power of two and at most BLOCK_ALIGN for plain requests
+ */
+static void *arena_malloc(heap_arena_t *arena, size_t alignment, size_t size) {
+    if (size <= arena->slab_max_size && alignment <= SLAB_GRANULE) {
+        void *slot = slab_malloc(&arena->slabs, size);
+        if (slot) return slot;
+    }
+
+    void *ptr = STRATEGY_CALL(arena, memalign, alignment, size);
+
+    if (ptr) block_stamp((block_header_t *)((char *)ptr - HEADER_SIZE), arena->index);
+    return ptr;
+}
+
+/**
+ * Resizes a strategy block in place, returns NULL if it has to move
+ */
+static void *arena_resize(heap_arena_t *arena, void *ptr, size_t size) {
+    void *resized = STRATEGY_CALL(arena, resize, ptr, size);
+    if (resized == NULL) return NULL;
+
+    // Growing to the left starts the block at a new header, the old one is payload now
+#ifdef TDMM_HARDENED
+    if (resized != ptr) page_map_set_live(ptr, false);
+#endif
+    block_stamp((block_header_t *)((char *)resized - HEADER_SIZE), arena->index);
+    return resized;
+}
+
+/**
+ * Allocates up to count blocks from an arena, slab slots first for small sizes
+ */
+static size_t arena_malloc_batch(heap_arena_t *arena, size_t size, size_t count, void **out) {
+    size_t done = 0;
+    if (size <= arena->slab_max_size) {
+        while (done < count && (out[done] = slab_malloc(&arena->slabs, size)) != NULL) done++;
+        if (done == count) return done;
+    }
+
+    void **rest = out + done;
+    size_t carved = STRATEGY_CALL(arena, malloc_batch, size, count - done, rest);
+
+    for (size_t i = 0; i < carved; i++) block_stamp((block_header_t *)((char *)rest[i] - HEADER_SIZE), arena->index);
+    return done + carved;
+}
+
+/**
+ * Frees blocks of one arena, sorted by address
+ */
+static void arena_free_batch(heap_arena_t *arena, void **ptrs, size_t count) {
+    size_t i = 0;
+    while (i < count) {
+        if (slab_contains(ptrs[i])) {
+            slab_free(&arena->slabs, ptrs[i++]);
+            continue;
+        }
+
+        // Each stretch of strategy blocks is handed over in one call
+        size_t end = i + 1;
+        while (end < count && !slab_contains(ptrs[end])) end++;
+
+        STRATEGY_CALL(arena, free_batch, ptrs + i, end - i);
+        i = end;
+    }
+}
+
+static void arena_free(heap_arena_t *arena, void *ptr) {
+    if (slab_contains(ptr)) slab_free(&arena->slabs, ptr);
+    else STRATEGY_CALL(arena, free, ptr);
+}
+
+/**
+ * Returns -1 if the first region can't be mapped. The arena then stays uninitialized,
+ * with empty slabs and free lists, so its next lock tries again
+ */
+static int arena_init(heap_arena_t *arena, const region_config_t *config) {
+    slab_cache_init(&arena->slabs, arena->index);
+    if (STRATEGY_CALL(arena, init, config) != 0) return -1;
+
+    __atomic_store_n(&arena->initialized, true, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/**
+ * Unmaps every region of an arena. Its slabs stay in the shared reservation
+ */
+static void arena_destroy(heap_arena_t *arena) {
+    STRATEGY_CALL(arena, destroy);
+
+    __atomic_store_n(&arena->initialized, false, __ATOMIC_RELEASE);
+}
+
+static void arena_purge(heap_arena_t *arena) {
+    STRATEGY_CALL(arena, purge);
+}
+
+static size_t arena_get_total_mapped_memory(heap_arena_t *arena) {
+    return STRATEGY_CALL(arena, get_total_mapped_memory);
+}
+
+static size_t arena_get_total_released_memory(heap_arena_t *arena) {
+    return STRATEGY_CALL(arena, get_total_released_memory);
+}
+
+static size_t arena_get_currently_allocated_memory(heap_arena_t *arena) {
+    return STRATEGY_CALL(arena, get_currently_allocated_memory);
+}
+
+static size_t arena_get_structural_overhead(heap_arena_t *arena) {
+    return STRATEGY_CALL(arena, get_structural_overhead);
+}
+
+static void arena_get_stats(heap_arena_t *arena, strategy_stats_t *stats) {
+    STRATEGY_CALL(arena, get_stats, stats);
+}
+
+static bool arena_peek_stats(heap_arena_t *arena, strategy_stats_t *stats) {
+    return STRATEGY_CALL(arena, peek_stats, stats);
+}
+
+static region_list_t *arena_get_regions(heap_arena_t *arena) {
+    return STRATEGY_CALL(arena, get_regions);
+}
+
+/**
+ * Whether the arena's heap is set up, for the stats that read it without the lock
+ */
+static bool arena_ready(heap_arena_t *arena) {
+    return __atomic_load_n(&arena->initialized, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * Returns the footprint of the blocks other threads handed back to the arena that it
+ * has not freed yet, and their number through count
+ */
+static size_t arena_remote_pending(heap_arena_t *arena, size_t *count) {
+#ifdef TDMM_THREAD_SAFE
+    *count = __atomic_load_n(&arena->remote_free_count, __ATOMIC_RELAXED);
+    return __atomic_load_n(&arena->remote_free_bytes, __ATOMIC_RELAXED);
+#else
+    (void)arena;
+    *count = 0;
+    return 0;
+#endif
+}
+
+#ifdef TDMM_THREAD_SAFE
+
+/**
+ * Pushes a block owned by another arena on that arena's return stack.
+ * Lock-free, any number of threads may push concurrently
+ */
+static void arena_push_remote(heap_arena_t *arena, void *ptr, size_t footprint) {
+    remote_free_t *entry = (remote_free_t *)ptr;
+    entry->footprint = footprint;
+    __atomic_fetch_add(&arena->remote_free_bytes, footprint, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&arena->remote_free_count, 1, __ATOMIC_RELAXED);
+
+    remote_free_t *head = __atomic_load_n(&arena->remote_free_head, __ATOMIC_RELAXED);
+    do {
+        entry->next = head;
+    } while (!__atomic_compare_exchange_n(&arena->remote_free_head, &head, entry, true,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+/**
+ * Frees every block other threads handed back. The whole stack is detached with
+ * one exchange, so there is no ABA problem. Caller holds the arena lock
+ */
+static void arena_drain_remote_locked(heap_arena_t *arena) {
+    if (__atomic_load_n(&arena->remote_free_head, __ATOMIC_RELAXED) == NULL) return;
+
+    remote_free_t *curr = __atomic_exchange_n(&arena->remote_free_head, NULL, __ATOMIC_ACQUIRE);
+    while (curr != NULL) {
+        remote_free_t *next = curr->next;
+        // Uncounted first, so the stats may briefly count the block twice but never miss it
+        __atomic_fetch_sub(&arena->remote_free_bytes, curr->footprint, __ATOMIC_RELAXED);
+        __atomic_fetch_sub(&arena->remote_free_count, 1, __ATOMIC_RELAXED);
+        arena_free(arena, curr);
+        curr = next;
+    }
+}
+
+static void arena_lock(heap_arena_t *arena) {
+    pthread_mutex_lock(&arena->lock);
+    if (!arena->initialized) arena_init(arena, &region_config);
+}
+
+static void arena_unlock(heap_arena_t *arena) {
+    pthread_mutex_unlock(&arena->lock);
+}
+
+// Per-thread caches hold freed blocks of up to TCACHE_MAX_SIZE bytes in classes of one granule.
+// A refill of class c asks for (c + 1) granules. With the granule a multiple of the alignment
+// the block comes back less than a granule larger, so it is filed under c again when freed
+#define TCACHE_MAX_SIZE 1024
+#define TCACHE_GRANULE (BLOCK_ALIGN > SLAB_GRANULE ? BLOCK_ALIGN : SLAB_GRANULE)
+#define TCACHE_NUM_CLASSES (TCACHE_MAX_SIZE / TCACHE_GRANULE)
+// Slab slots are cached by slot_size / TCACHE_GRANULE without reading their slab
+_Static_assert(TCACHE_GRANULE % BLOCK_ALIGN == 0 && TCACHE_GRANULE % SLAB_GRANULE == 0,
+               "thread cache classes must hold whole blocks and slab slots");
+#define TCACHE_MAX_COUNT 32
+// Blocks moved between a thread cache and its arena per lock acquisition
+#define TCACHE_BATCH 16
+
+typedef struct tcache_entry {
+    struct tcache_entry *next;
+    size_t footprint;  // What the block counts as allocated in its arena, so the stats never read its header
+} tcache_entry_t;
+
+typedef struct tcache {
+    tcache_entry_t *bins[TCACHE_NUM_CLASSES];
+    unsigned counts[TCACHE_NUM_CLASSES];
+    size_t cached_bytes;   // Header + payload of every cached block, for the stats
+    size_t cached_count;   // Blocks over all bins, for the stats
+    unsigned generation;   // Heap the cached blocks belong to, see t_init
+    heap_arena_t *arena;   // Arena this thread is bound to
+
+    bool registered;
+    struct tcache *next;
+    struct tcache *prev;
+} tcache_t;
+
+static pthread_mutex_t tcache_list_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t arena_locks_once = PTHREAD_ONCE_INIT;
+static pthread_once_t tcache_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t tcache_key;
+
+// Every live thread cache, guarded by tcache_list_lock
+static tcache_t *tcache_list_head = NULL;
+static unsigned heap_generation = 0;
+static unsigned next_arena = 0;
+
+static __thread tcache_t tcache;
+
+/**
+ * Returns the bytes a cached block counts as allocated in its arena's stats
+ */
+static size_t block_footprint(void *ptr) {
+    if (slab_contains(ptr)) return slab_of(ptr)->slot_size;
+    return block_size((block_header_t *)((char *)ptr - HEADER_SIZE)) + HEADER_SIZE;
+}
+
+/**
+ * Returns the cached bytes of every thread still holding blocks of the current heap,
+ * and their number of blocks through count unless it is NULL
+ */
+static size_t tcache_total_cached_bytes(size_t *count) {
+    size_t total = 0;
+    size_t blocks = 0;
+    pthread_mutex_lock(&tcache_list_lock);
+    for (tcache_t *curr = tcache_list_head; curr != NULL; curr = curr->next) {
+        if (__atomic_load_n(&curr->generation, __ATOMIC_RELAXED) != heap_generation) continue;
+        total += __atomic_load_n(&curr->cached_bytes, __ATOMIC_RELAXED);
+        blocks += __atomic_load_n(&curr->cached_count, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&tcache_list_lock);
+    if (count != NULL) *count = blocks;
+    return total;
+}
+
+static void tcache_push(tcache_t *cache, size_t class_idx, void *ptr, size_t footprint) {
+    tcache_entry_t *entry = (tcache_entry_t *)ptr;
+    entry->next = cache->bins[class_idx];
+    entry->footprint = footprint;
+    cache->bins[class_idx] = entry;
+    cache->counts[class_idx]++;
+    __atomic_store_n(&cache->cached_bytes,
+                     cache->cached_bytes + footprint,
+                     __ATOMIC_RELAXED);
+    __atomic_store_n(&cache->cached_count, cache->cached_count + 1, __ATOMIC_RELAXED);
+}
+
+static void *tcache_pop(tcache_t *cache, size_t class_idx) {
+    tcache_entry_t *entry = cache->bins[class_idx];
+    cache->bins[class_idx] = entry->next;
+    cache->counts[class_idx]--;
+    __atomic_store_n(&cache->cached_bytes,
+                     cache->cached_bytes - entry->footprint,
+                     __ATOMIC_RELAXED);
+    __atomic_store_n(&cache->cached_count, cache->cached_count - 1, __ATOMIC_RELAXED);
+    return entry;
+}
+
+#ifdef TDMM_HARDENED
+/**
+ * Marks a block taken back out of a thread cache as allocated again
+ */
+static void mark_live(void *ptr) {
+    if (slab_contains(ptr)) slab_mark_live(ptr);
+    else page_map_set_live(ptr, true);
+}
+#endif
+
+/**
+ * Returns up to count blocks of a class to their owning arenas. Blocks of the
+ * thread's own arena are freed directly, caller holds that arena's lock
+ */
+static void tcache_flush_locked(tcache_t *cache, size_t class_idx, unsigned count) {
+    while (count-- > 0 && cache->bins[class_idx] != NULL) {
+        void *ptr = tcache_pop(cache, class_idx);
+        heap_arena_t *owner = &arenas[block_arena(ptr)];
+
+        if (owner == cache->arena) arena_free(owner, ptr);
+        else arena_push_remote(owner, ptr, ((tcache_entry_t *)ptr)->footprint);
+    }
+}
+
+/**
+ * Returns every cached block, caller holds the lock of the thread's arena
+ */
+static void tcache_flush_all_locked(tcache_t *cache) {
+    for (size_t i = 0; i < TCACHE_NUM_CLASSES; i++) {
+        tcache_flush_locked(cache, i, cache->counts[i]);
+    }
+}
+
+/**
+ * Caches a freed block, first making room in a full bin
+ */
+static void tcache_free(tcache_t *cache, size_t class_idx, void *ptr, size_t footprint) {
+    if (cache->counts[class_idx] >= TCACHE_MAX_COUNT) {
+        arena_lock(cache->arena);
+        tcache_flush_locked(cache, class_idx, TCACHE_BATCH);
+        arena_unlock(cache->arena);
+    }
+
+    tcache_push(cache, class_idx, ptr, footprint);
+}
+
+/**
+ * Flushes a thread's cache and unregisters it when the thread exits
+ */
+static void tcache_destroy(void *arg) {
+    tcache_t *cache = (tcache_t *)arg;
+
+    if (cache->generation == __atomic_load_n(&heap_generation, __ATOMIC_ACQUIRE)) {
+        arena_lock(cache->arena);
+        tcache_flush_all_locked(cache);
+        // The arena may not see another malloc for a while
+        arena_drain_remote_locked(cache->arena);
+        arena_unlock(cache->arena);
+    }
+
+    pthread_mutex_lock(&tcache_list_lock);
+    if (cache->prev) cache->prev->next = cache->next;
+    else tcache_list_head = cache->next;
+    if (cache->next) cache->next->prev = cache->prev;
+    cache->registered = false;
+    pthread_mutex_unlock(&tcache_list_lock);
+}
+
+static void arena_init_locks() {
+    for (unsigned i = 0; i < MAX_ARENAS; i++) pthread_mutex_init(&arenas[i].lock, NULL);
+}
+
+static void tcache_create_key() {
+    pthread_key_create(&tcache_key, tcache_destroy);
+}
+
+/**
+ * Binds the thread to the next arena in round-robin order
+ */
+static void tcache_bind_arena(tcache_t *cache) {
+    unsigned idx = __atomic_fetch_add(&next_arena, 1, __ATOMIC_RELAXED);
+    cache->arena = &arenas[idx % num_arenas];
+}
+
+/**
+ * Returns the calling thread's cache, registering it on first use and dropping
+ * blocks and the arena binding left over from a heap that t_init has since replaced
+ */
+static tcache_t *tcache_get() {
+    tcache_t *cache = &tcache;
+
+    if (!cache->registered) {
+        pthread_once(&tcache_key_once, tcache_create_key);
+        pthread_setspecific(tcache_key, cache);
+
+        pthread_mutex_lock(&tcache_list_lock);
+        cache->generation = heap_generation;
+        cache->prev = NULL;
+        cache->next = tcache_list_head;
+        if (tcache_list_head) tcache_list_head->prev = cache;
+        tcache_list_head = cache;
+        cache->registered = true;
+        pthread_mutex_unlock(&tcache_list_lock);
+
+        tcache_bind_arena(cache);
+    }
+
+    if (cache->generation != __atomic_load_n(&heap_generation, __ATOMIC_ACQUIRE)) {
+        for (size_t i = 0; i < TCACHE_NUM_CLASSES; i++) {
+            cache->bins[i] = NULL;
+            cache->counts[i] = 0;
+        }
+        __atomic_store_n(&cache->cached_bytes, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&cache->cached_count, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&cache->generation, heap_generation, __ATOMIC_RELAXED);
+        tcache_bind_arena(cache);
+    }
+
+    return cache;
+}
+
+#else
+#define arena_lock(arena) ((arena)->initialized ? (void)0 : (void)arena_init(arena, &region_config))
+#define arena_unlock(arena) ((void)0)
+#define arena_drain_remote_locked(arena) ((void)0)
+#endif
+
+void t_purge() {
+#ifdef TDMM_THREAD_SAFE
+    // Cached blocks keep their regions from being unmapped, the caller's go back first
+    tcache_t *cache = &tcache;
+    if (cache->registered && cache->generation == __atomic_load_n(&heap_generation, __ATOMIC_ACQUIRE)) {
+        arena_lock(cache->arena);
+        tcache_flush_all_locked(cache);
+        arena_unlock(cache->arena);
+    }
+#endif
+
+    for (unsigned i = 0; i < num_arenas; i++) {
+        if (!arenas[i].initialized) continue;
+        arena_lock(&arenas[i]);
+        arena_drain_remote_locked(&arenas[i]);
+        arena_purge(&arenas[i]);
+        arena_unlock(&arenas[i]);
+    }
+}
+
+// The getters below read each arena's counters without its lock and leave its return stack
+// alone, so they never wait on an allocating thread. Blocks pending on the stack are taken off
+// the arena's allocated totals instead
 
 size_t t_get_total_mapped_memory() {
-    if (current_strat == FIRST_FIT) return first_fit_get_total_mapped_memory();
-    if (current_strat == BEST_FIT) return best_fit_get_total_mapped_memory();
-    return worst_fit_get_total_mapped_memory();
+    size_t total = 0;
+    for (unsigned i = 0; i < num_arenas; i++) {
+        if (!arena_ready(&arenas[i])) continue;
+        total += arena_get_total_mapped_memory(&arenas[i]) + slab_get_total_mapped_memory(&arenas[i].slabs);
+    }
+    return total + __atomic_load_n(&direct_mapped, __ATOMIC_RELAXED) + __atomic_load_n(&bump_mapped, __ATOMIC_RELAXED);
+}
+
+size_t t_get_total_released_memory() {
+    size_t total = 0;
+    for (unsigned i = 0; i < num_arenas; i++) {
+        if (!arena_ready(&arenas[i])) continue;
+        total += arena_get_total_released_memory(&arenas[i]);
+    }
+    return total + __atomic_load_n(&direct_released, __ATOMIC_RELAXED) + __atomic_load_n(&bump_released, __ATOMIC_RELAXED);
 }
 
 size_t t_get_currently_allocated_memory() {
-    if (current_strat == FIRST_FIT) return first_fit_get_currently_allocated_memory();
-    if (current_strat == BEST_FIT) return best_fit_get_currently_allocated_memory();
-    return worst_fit_get_currently_allocated_memory();
+    size_t allocated = 0;
+    size_t pending = 0;
+    for (unsigned i = 0; i < num_arenas; i++) {
+        if (!arena_ready(&arenas[i])) continue;
+        size_t pending_blocks;
+        allocated += arena_get_currently_allocated_memory(&arenas[i]) + slab_get_currently_allocated_memory(&arenas[i].slabs);
+        pending += arena_remote_pending(&arenas[i], &pending_blocks);
+    }
+    allocated += __atomic_load_n(&direct_mapped, __ATOMIC_RELAXED) + __atomic_load_n(&bump_mapped, __ATOMIC_RELAXED);
+#ifdef TDMM_THREAD_SAFE
+    // Blocks parked in thread caches are allocated as far as the arenas know
+    pending += tcache_total_cached_bytes(NULL);
+#endif
+    // Counters read while other threads move blocks may disagree, the total never goes below zero
+    return allocated > pending ? allocated - pending : 0;
 }
 
 size_t t_get_structural_overhead() {
-    if (current_strat == FIRST_FIT) return first_fit_get_structural_overhead();
-    if (current_strat == BEST_FIT) return best_fit_get_structural_overhead();
-    return worst_fit_get_structural_overhead();
+    size_t overhead = 0;
+    for (unsigned i = 0; i < num_arenas; i++) {
+        if (!arena_ready(&arenas[i])) continue;
+        overhead += arena_get_structural_overhead(&arenas[i]) + slab_get_structural_overhead(&arenas[i].slabs);
+    }
+    // Direct mappings spend their link and header in front of the payload
+    return overhead + __atomic_load_n(&direct_count, __ATOMIC_RELAXED) * DIRECT_PAD;
+}
+
+void t_get_stats(tdmm_stats_t *stats) {
+    memset(stats, 0, sizeof(*stats));
+    size_t pending_bytes = 0;
+    size_t pending_blocks = 0;
+    for (unsigned i = 0; i < num_arenas; i++) {
+        heap_arena_t *arena = &arenas[i];
+        if (!arena_ready(arena)) continue;
+
+        // Only a largest free block that was allocated whole needs the lock, to look up the next one
+        strategy_stats_t heap_stats;
+        if (!arena_peek_stats(arena, &heap_stats)) {
+            arena_lock(arena);
+            arena_get_stats(arena, &heap_stats);
+            arena_unlock(arena);
+        }
+        stats->mapped_bytes += arena_get_total_mapped_memory(arena) + slab_get_total_mapped_memory(&arena->slabs);
+        stats->released_bytes += arena_get_total_released_memory(arena);
+        stats->allocated_bytes += arena_get_currently_allocated_memory(arena) + slab_get_currently_allocated_memory(&arena->slabs);
+        stats->overhead_bytes += arena_get_structural_overhead(arena) + slab_get_structural_overhead(&arena->slabs);
+        stats->allocated_blocks += heap_stats.num_allocated + slab_get_num_allocated(&arena->slabs);
+        stats->free_blocks += heap_stats.num_free;
+        stats->free_bytes += heap_stats.free_bytes;
+        if (heap_stats.largest_free > stats->largest_free_block) stats->largest_free_block = heap_stats.largest_free;
+
+        size_t remote_blocks;
+        pending_bytes += arena_remote_pending(arena, &remote_blocks);
+        pending_blocks += remote_blocks;
+    }
+
+    size_t direct_blocks = __atomic_load_n(&direct_count, __ATOMIC_RELAXED);
+    size_t direct_bytes = __atomic_load_n(&direct_mapped, __ATOMIC_RELAXED);
+    size_t bump_bytes = __atomic_load_n(&bump_mapped, __ATOMIC_RELAXED);
+    stats->mapped_bytes += direct_bytes + bump_bytes;
+    stats->released_bytes += __atomic_load_n(&direct_released, __ATOMIC_RELAXED) + __atomic_load_n(&bump_released, __ATOMIC_RELAXED);
+    stats->allocated_bytes += direct_bytes + bump_bytes;
+    stats->overhead_bytes += direct_blocks * DIRECT_PAD;
+    stats->allocated_blocks += direct_blocks;
+#ifdef TDMM_THREAD_SAFE
+    size_t cached_blocks;
+    pending_bytes += tcache_total_cached_bytes(&cached_blocks);
+    pending_blocks += cached_blocks;
+#endif
+    stats->allocated_bytes = stats->allocated_bytes > pending_bytes ? stats->allocated_bytes - pending_bytes : 0;
+    stats->allocated_blocks = stats->allocated_blocks > pending_blocks ? stats->allocated_blocks - pending_blocks : 0;
+}
+
+/**
+ * Hands the blocks of one region or slab to the callback of t_heap_walk
+ */
+typedef struct heap_walk {
+    tdmm_walk_fn walk;
+    void *arg;
+    tdmm_block_info_t info;  // Fields shared by the blocks being visited
+} heap_walk_t;
+
+static void heap_walk_visit(void *payload, size_t size, bool free, void *ctx) {
+    heap_walk_t *walk = ctx;
+    walk->info.ptr = payload;
+    walk->info.size = size;
+    walk->info.free = free;
+    walk->walk(&walk->info, walk->arg);
+}
+
+void t_heap_walk(tdmm_walk_fn walk, void *arg) {
+    heap_walk_t ctx;
+    ctx.walk = walk;
+    ctx.arg = arg;
+
+    // Locked in index order, no other path holds two arena locks at once. An arena
+    // another thread initializes meanwhile has no blocks yet and is left out
+    bool locked[MAX_ARENAS];
+    for (unsigned i = 0; i < num_arenas; i++) {
+        locked[i] = arenas[i].initialized;
+        if (!locked[i]) continue;
+        arena_lock(&arenas[i]);
+        arena_drain_remote_locked(&arenas[i]);
+    }
+
+    // The slabs share one reserved range, visited where its base falls among the regions
+    char *slabs_end = __atomic_load_n(&slab_reservation.next, __ATOMIC_RELAXED);
+    if (slabs_end > slab_reservation.end) slabs_end = slab_reservation.end;
+    bool slabs_pending = slabs_end != slab_reservation.base;
+
+    // Each arena lists its regions in address order, merged here one region at a time
+    region_t *cursors[MAX_ARENAS];
+    for (unsigned i = 0; i < num_arenas; i++) cursors[i] = locked[i] ? arena_get_regions(&arenas[i])->head : NULL;
+
+    for (;;) {
+        region_t *next = NULL;
+        unsigned next_arena = 0;
+        for (unsigned i = 0; i < num_arenas; i++) {
+            if (cursors[i] != NULL && (next == NULL || cursors[i]->base < next->base)) {
+                next = cursors[i];
+                next_arena = i;
+            }
+        }
+
+        if (slabs_pending && (next == NULL || slab_reservation.base < (char *)next->base)) {
+            ctx.info.slab = true;
+            for (char *slab = slab_reservation.base; slab < slabs_end; slab += SLAB_SIZE) {
+                ctx.info.arena = ((slab_t *)slab)->arena;
+                if (ctx.info.arena < num_arenas && locked[ctx.info.arena]) slab_walk((slab_t *)slab, heap_walk_visit, &ctx);
+            }
+            slabs_pending = false;
+            continue;
+        }
+        if (next == NULL) break;
+
+        ctx.info.slab = false;
+        ctx.info.arena = next_arena;
+        region_walk(next, heap_walk_visit, &ctx);
+        cursors[next_arena] = next->next;
+    }
+
+    for (unsigned i = 0; i < num_arenas; i++) {
+        if (locked[i]) arena_unlock(&arenas[i]);
+    }
+}
+
+#if FREE_STATS_BUCKETS != TDMM_FREE_HISTOGRAM_BUCKETS
+#error "TDMM_FREE_HISTOGRAM_BUCKETS must match FREE_STATS_BUCKETS"
+#endif
+
+void t_fragmentation_report(tdmm_fragmentation_report_t *report) {
+    memset(report, 0, sizeof(*report));
+    for (unsigned i = 0; i < num_arenas; i++) {
+        heap_arena_t *arena = &arenas[i];
+        if (!arena->initialized) continue;
+        arena_lock(arena);
+        arena_drain_remote_locked(arena);
+
+        strategy_stats_t heap_stats;
+        arena_get_stats(arena, &heap_stats);
+        for (size_t bucket = 0; bucket < FREE_STATS_BUCKETS; bucket++) {
+            report->free_histogram[bucket] += heap_stats.free_histogram[bucket];
+        }
+        report->free_blocks += heap_stats.num_free;
+        report->free_bytes += heap_stats.free_bytes;
+        if (heap_stats.largest_free > report->largest_free_block) report->largest_free_block = heap_stats.largest_free;
+
+        region_list_t *regions = arena_get_regions(arena);
+        report->num_regions += regions->num_regions;
+        report->region_bytes += regions->total_mapped;
+        report->slab_bytes += slab_get_total_mapped_memory(&arena->slabs);
+        report->slab_allocated_bytes += slab_get_currently_allocated_memory(&arena->slabs);
+
+        arena_unlock(arena);
+    }
+
+    if (report->free_bytes > 0) {
+        report->external_fragmentation = 1.0 - (double)report->largest_free_block / report->free_bytes;
+    }
+}
+
+#ifdef TDMM_COUNTERS
+/**
+ * Adds the counters of one arena to a sum. Takes the arena's lock
+ */
+static void arena_add_counters(heap_arena_t *arena, tdmm_counters_t *sum) {
+    arena_lock(arena);
+    arena_drain_remote_locked(arena);
+
+    strategy_stats_t heap_stats;
+    arena_get_stats(arena, &heap_stats);
+    sum->searches += heap_stats.counters.searches;
+    sum->search_steps += heap_stats.counters.search_steps;
+    sum->exact_fits += heap_stats.counters.exact_fits;
+    sum->splits += heap_stats.counters.splits;
+    sum->coalesce_left += heap_stats.counters.coalesce_left;
+    sum->coalesce_right += heap_stats.counters.coalesce_right;
+    sum->grows += heap_stats.counters.grows;
+    sum->grow_bytes += heap_stats.counters.grow_bytes;
+
+    arena_unlock(arena);
+}
+#endif
+
+int t_get_counters(tdmm_counters_t *counters) {
+    memset(counters, 0, sizeof(*counters));
+#ifdef TDMM_COUNTERS
+    for (unsigned i = 0; i < num_arenas; i++) {
+        if (arenas[i].initialized) arena_add_counters(&arenas[i], counters);
+    }
+    return 0;
+#else
+    errno = ENOTSUP;
+    return -1;
+#endif
+}
+
+int t_trace_start(const char *path) {
+#ifdef TDMM_TRACE
+    return trace_open(path);
+#else
+    (void)path;
+    errno = ENOTSUP;
+    return -1;
+#endif
+}
+
+void t_trace_stop() {
+#ifdef TDMM_TRACE
+    trace_close();
+#endif
 }
 
-void t_init(alloc_strat_e strat) {
-	current_strat = strat;
-    
-    // Initializing with 1 page
-    size_t initial_size = 4096; 
-    
-    if (strat == FIRST_FIT) first_fit_init(initial_size);
-    else if (strat == BEST_FIT) best_fit_init(initial_size);
-    else if (strat == WORST_FIT) worst_fit_init(initial_size);
+void t_default_options(tdmm_options_t *opts) {
+    opts->initial_size = DEFAULT_INITIAL_SIZE;
+    opts->min_chunk = DEFAULT_MIN_CHUNK;
+    opts->max_chunk = DEFAULT_MAX_CHUNK;
+    opts->reserve_bytes = 0;
+    opts->retain_bytes = DEFAULT_RETAIN_BYTES;
+    opts->purge_threshold = DEFAULT_PURGE_THRESHOLD;
+    opts->decay_ms = DEFAULT_DECAY_MS;
+    opts->purge_lazy = false;
+    opts->mmap_threshold = DEFAULT_MMAP_THRESHOLD;
+    opts->slab_max_size = SLAB_MAX_SIZE;
+}
+
+static void region_config_from_options(region_config_t *config, const tdmm_options_t *opts) {
+    config->initial_size = opts->initial_size;
+    config->min_chunk = opts->min_chunk;
+    config->max_chunk = opts->max_chunk;
+    config->reserve_bytes = opts->reserve_bytes;
+    config->retain_bytes = opts->retain_bytes;
+    config->purge_threshold = opts->purge_threshold;
+    config->decay_ms = opts->decay_ms;
+    config->purge_lazy = opts->purge_lazy;
+}
+
+int t_init(alloc_strat_e strat) {
+    return t_init_with_options(strat, NULL);
+}
+
+int t_init_with_options(alloc_strat_e strat, const tdmm_options_t *opts) {
+    // Checked first, a strategy that isn't linked leaves the current heap as it is
+    const strategy_ops_t *ops = strategy_ops(strat);
+    if (ops == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    tdmm_options_t defaults;
+    if (opts == NULL) {
+        t_default_options(&defaults);
+        opts = &defaults;
+    }
+
+    region_config_from_options(&region_config, opts);
+    mmap_threshold = opts->mmap_threshold ? opts->mmap_threshold : SIZE_MAX;
+    direct_unmap_all();
+    direct_mapped = 0;
+    direct_released = 0;
+    direct_count = 0;
+    bump_released = 0;
+
+    // Sizes up to slab_max_size skip the strategy, as long as the slab range could be reserved
+    slab_max_size = opts->slab_max_size > SLAB_MAX_SIZE ? SLAB_MAX_SIZE : opts->slab_max_size;
+    if (slab_max_size > 0 && slab_reset() != 0) slab_max_size = 0;
+
+#ifdef TDMM_THREAD_SAFE
+    // One arena per core, each initialized by the first thread bound to it
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    num_arenas = cores < 1 ? 1 : (cores > MAX_ARENAS ? MAX_ARENAS : (unsigned)cores);
+    pthread_once(&arena_locks_once, arena_init_locks);
+#endif
+
+    for (unsigned i = 0; i < MAX_ARENAS; i++) {
+        // Blocks of the previous heap are dead once it is replaced, its regions go back to the OS
+        if (arenas[i].initialized) arena_destroy(&arenas[i]);
+        arenas[i].ops = ops;
+        arenas[i].slab_max_size = slab_max_size;
+        arenas[i].index = (unsigned char)i;
+#ifdef TDMM_THREAD_SAFE
+        arenas[i].remote_free_head = NULL;
+        arenas[i].remote_free_bytes = 0;
+        arenas[i].remote_free_count = 0;
+#endif
+    }
+
+    // The calling thread's arena is set up right away
+    arena_lock(&arenas[0]);
+    bool mapped = arenas[0].initialized;
+    arena_unlock(&arenas[0]);
+
+#ifdef TDMM_THREAD_SAFE
+    // Cached blocks belong to the old heap, threads drop them and rebind on their next call
+    __atomic_store_n(&next_arena, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&heap_generation, heap_generation + 1, __ATOMIC_RELEASE);
+#endif
+    if (!mapped) {
+        errno = ENOMEM;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * t_malloc without the trace event, for the calls the API makes itself
+ */
+static void *global_malloc(size_t size) {
+    if (size >= mmap_threshold) return direct_malloc(BLOCK_ALIGN, size);
+
+#ifdef TDMM_THREAD_SAFE
+    tcache_t *cache = tcache_get();
+    heap_arena_t *arena = cache->arena;
+
+    if (size > 0 && size <= TCACHE_MAX_SIZE) {
+        size_t class_idx = (size + TCACHE_GRANULE - 1) / TCACHE_GRANULE - 1;
+
+        if (cache->bins[class_idx] == NULL) {
+            // Refill a batch of blocks of this class with one lock acquisition
+            size_t class_size = (class_idx + 1) * TCACHE_GRANULE;
+            arena_lock(arena);
+            arena_drain_remote_locked(arena);
+            for (unsigned i = 0; i < TCACHE_BATCH; i++) {
+                void *ptr = arena_malloc(arena, BLOCK_ALIGN, class_size);
+                if (ptr == NULL) break;
+#ifdef TDMM_HARDENED
+                // Not live until handed out, a stray free of a cached block is caught like a double free
+                free_claim(ptr);
+#endif
+                tcache_push(cache, class_idx, ptr, block_footprint(ptr));
+            }
+            arena_unlock(arena);
+            if (cache->bins[class_idx] == NULL) return NULL;
+        }
+
+        void *ptr = tcache_pop(cache, class_idx);
+#ifdef TDMM_HARDENED
+        mark_live(ptr);
+#endif
+        return ptr;
+    }
+#else
+    heap_arena_t *arena = &arenas[0];
+#endif
+
+    arena_lock(arena);
+    arena_drain_remote_locked(arena);
+    void *ptr = arena_malloc(arena, BLOCK_ALIGN, size);
+    arena_unlock(arena);
+    return ptr;
 }
 
 void *t_malloc(size_t size) {
-    if (current_strat == FIRST_FIT) return first_fit_malloc(size);
-    if (current_strat == BEST_FIT) return best_fit_malloc(size);
-    if (current_strat == WORST_FIT) return worst_fit_malloc(size);
-    return NULL;
+    void *ptr = global_malloc(size);
+    TRACE_LOG(TRACE_MALLOC, ptr, 0, size);
+    return ptr;
+}
+
+void *t_calloc(size_t nmemb, size_t size) {
+    if (size != 0 && nmemb > SIZE_MAX / size) return NULL;
+    size_t total = nmemb * size;
+
+    void *ptr = global_malloc(total);
+    TRACE_LOG(TRACE_CALLOC, ptr, 0, total);
+    if (ptr == NULL) return NULL;
+
+    // Slots are small and recycled without any record of their contents
+    if (slab_contains(ptr)) {
+        memset(ptr, 0, total);
+        return ptr;
+    }
+
+    block_header_t *header = (block_header_t *)((char *)ptr - HEADER_SIZE);
+    // Direct mappings are always fresh pages
+    if (block_owner(header) == DIRECT_ARENA) return ptr;
+
+    if (block_flags(header) & BLOCK_ZEROED) {
+        // Only the free list links and the footer were written, the rest of the pages stay untouched
+        memset(ptr, 0, sizeof(block_header_t) - HEADER_SIZE);
+        memset((char *)ptr + block_size(header) - FOOTER_SIZE, 0, FOOTER_SIZE);
+        return ptr;
+    }
+
+    zero_fill(ptr, total);
+    return ptr;
+}
+
+size_t t_malloc_batch(size_t size, size_t count, void **out) {
+    if (size == 0) return 0;
+
+    size_t done = 0;
+    if (size >= mmap_threshold) {
+        while (done < count && (out[done] = direct_malloc(BLOCK_ALIGN, size)) != NULL) {
+            TRACE_LOG(TRACE_MALLOC, out[done], 0, size);
+            done++;
+        }
+        return done;
+    }
+
+    // The whole batch takes one lock and skips the thread cache
+#ifdef TDMM_THREAD_SAFE
+    heap_arena_t *arena = tcache_get()->arena;
+#else
+    heap_arena_t *arena = &arenas[0];
+#endif
+
+    arena_lock(arena);
+    arena_drain_remote_locked(arena);
+    done = arena_malloc_batch(arena, size, count, out);
+    arena_unlock(arena);
+#ifdef TDMM_TRACE
+    for (size_t i = 0; i < done; i++) trace_log(TRACE_MALLOC, out[i], 0, size);
+#endif
+    return done;
+}
+
+static int compare_addresses(const void *a, const void *b) {
+    uintptr_t left = (uintptr_t)*(void *const *)a;
+    uintptr_t right = (uintptr_t)*(void *const *)b;
+    return (left > right) - (left < right);
+}
+
+void t_free_batch(void **ptrs, size_t count) {
+#ifdef TDMM_HARDENED
+    // Blocks that can't be freed are reported and skipped
+    for (size_t i = 0; i < count; i++) {
+        if (ptrs[i] != NULL && !free_claim(ptrs[i])) ptrs[i] = NULL;
+    }
+#endif
+#ifdef TDMM_TRACE
+    for (size_t i = 0; i < count; i++) {
+        if (ptrs[i] != NULL) trace_log(TRACE_FREE, ptrs[i], 0, 0);
+    }
+#endif
+
+    // In address order, neighbouring blocks come next to each other and one
+    // arena's blocks cluster, so each cluster takes the owner's lock once
+    qsort(ptrs, count, sizeof(void *), compare_addresses);
+
+    size_t i = 0;
+    while (i < count) {
+        if (ptrs[i] == NULL) {
+            i++;
+            continue;
+        }
+
+        unsigned char owner_idx = block_arena(ptrs[i]);
+        if (owner_idx == DIRECT_ARENA) {
+            direct_free((block_header_t *)((char *)ptrs[i++] - HEADER_SIZE));
+            continue;
+        }
+
+        size_t end = i + 1;
+        while (end < count && block_arena(ptrs[end]) == owner_idx) end++;
+
+        heap_arena_t *owner = &arenas[owner_idx];
+        arena_lock(owner);
+        arena_free_batch(owner, ptrs + i, end - i);
+        arena_unlock(owner);
+        i = end;
+    }
+}
+
+/**
+ * Frees a block of the global heap, whichever way it was allocated
+ */
+static void free_block(void *ptr) {
+    // Slab slots have no header, they must be ruled out before one is read
+    block_header_t *header = NULL;
+    if (!slab_contains(ptr)) {
+        header = (block_header_t *)((char *)ptr - HEADER_SIZE);
+        if (block_owner(header) == DIRECT_ARENA) {
+            direct_free(header);
+            return;
+        }
+    }
+
+#ifdef TDMM_THREAD_SAFE
+    tcache_t *cache = tcache_get();
+
+    // A block of usable size n can serve any request up to n, so it goes in class floor(n / granule)
+    size_t usable = block_usable_size(ptr);
+    if (usable >= TCACHE_GRANULE && usable < (TCACHE_NUM_CLASSES + 1) * TCACHE_GRANULE) {
+        // The block skips the strategy's free, which would drop this too
+        if (header) block_set_atomic(header, BLOCK_ZEROED, false);
+        tcache_free(cache, usable / TCACHE_GRANULE - 1, ptr, header ? usable + HEADER_SIZE : usable);
+        return;
+    }
+
+    // Blocks of other arenas go back through the owner's return stack
+    heap_arena_t *owner = &arenas[block_arena(ptr)];
+    if (owner != cache->arena) {
+        arena_push_remote(owner, ptr, block_footprint(ptr));
+        return;
+    }
+#else
+    heap_arena_t *owner = &arenas[0];
+#endif
+
+    arena_lock(owner);
+    arena_free(owner, ptr);
+    arena_unlock(owner);
+}
+
+/**
+ * t_free of a block other than NULL, without the trace event
+ */
+static void global_free(void *ptr) {
+#ifdef TDMM_HARDENED
+    if (!free_claim(ptr)) return;
+#endif
+
+    free_block(ptr);
+}
+
+/**
+ * t_realloc without the trace event
+ */
+static void *global_realloc(void *ptr, size_t size) {
+    if (ptr == NULL) return global_malloc(size);
+    if (size == 0) {
+        global_free(ptr);
+        return NULL;
+    }
+
+    size_t usable = block_usable_size(ptr);
+    if (slab_contains(ptr)) {
+        // Slots have a fixed size, one of the same class is kept
+        if (size <= usable && size > usable - SLAB_GRANULE) return ptr;
+    }
+    else {
+        block_header_t *header = (block_header_t *)((char *)ptr - HEADER_SIZE);
+        if (block_owner(header) == DIRECT_ARENA) {
+            if (size >= mmap_threshold) return direct_realloc(header, size);
+        }
+        else if (size < mmap_threshold) {
+            // The owner's lock guards the neighbours, whichever arena the caller is bound to
+            heap_arena_t *owner = &arenas[block_owner(header)];
+            arena_lock(owner);
+            void *resized = arena_resize(owner, ptr, size);
+            arena_unlock(owner);
+            if (resized) return resized;
+        }
+    }
+
+    void *moved = global_malloc(size);
+    if (moved == NULL) return NULL;
+    memcpy(moved, ptr, usable < size ? usable : size);
+    global_free(ptr);
+    return moved;
+}
+
+void *t_realloc(void *ptr, size_t size) {
+    void *resized = global_realloc(ptr, size);
+    // Logged once it returned, see trace.h
+    TRACE_LOG(TRACE_REALLOC, resized, (uintptr_t)ptr, size);
+    return resized;
+}
+
+/**
+ * t_aligned_alloc without the trace event
+ */
+static void *global_aligned_alloc(size_t alignment, size_t size) {
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0) return NULL;
+    if (alignment <= BLOCK_ALIGN) return global_malloc(size);
+    if (size >= mmap_threshold || alignment >= mmap_threshold) return direct_malloc(alignment, size);
+
+    // Cached blocks are only BLOCK_ALIGN aligned, so aligned requests go to the arena
+#ifdef TDMM_THREAD_SAFE
+    heap_arena_t *arena = tcache_get()->arena;
+#else
+    heap_arena_t *arena = &arenas[0];
+#endif
+
+    arena_lock(arena);
+    arena_drain_remote_locked(arena);
+    void *ptr = arena_malloc(arena, alignment, size);
+    arena_unlock(arena);
+    return ptr;
+}
+
+void *t_aligned_alloc(size_t alignment, size_t size) {
+    void *ptr = global_aligned_alloc(alignment, size);
+    TRACE_LOG(TRACE_ALIGNED, ptr, alignment, size);
+    return ptr;
+}
+
+int t_posix_memalign(void **memptr, size_t alignment, size_t size) {
+    if (alignment < sizeof(void *) || (alignment & (alignment - 1)) != 0) return EINVAL;
+
+    void *ptr = t_aligned_alloc(alignment, size);
+    if (ptr == NULL && size > 0) return ENOMEM;
+
+    *memptr = ptr;
+    return 0;
 }
 
 void t_free(void *ptr) {
-    if (current_strat == FIRST_FIT) first_fit_free(ptr);
-    else if (current_strat == BEST_FIT) best_fit_free(ptr);
-    else if (current_strat == WORST_FIT) worst_fit_free(ptr);
+    if (ptr == NULL) return;
+    // Logged before the block can be handed out again
+    TRACE_LOG(TRACE_FREE, ptr, 0, 0);
+    global_free(ptr);
+}
+
+#ifdef TDMM_VERIFY_SIZED_FREE
+/**
+ * Aborts unless size is one the block could have been allocated or last resized with
+ */
+static void verify_free_size(void *ptr, size_t size) {
+    size_t usable = block_usable_size(ptr);
+    bool valid;
+    if (slab_contains(ptr)) {
+        valid = size <= usable && size > usable - SLAB_GRANULE;
+    }
+    else if (block_arena(ptr) == DIRECT_ARENA) {
+        valid = size <= usable && usable - size < PAGE_SIZE;
+    }
+    else {
+        // Rounded up to a block, plus a tail too small to split off
+        size_t payload = block_payload_size(size);
+        valid = size > 0 && payload > 0 && payload <= usable && usable - payload < MIN_BLOCK_SIZE;
+    }
+
+    if (!valid) {
+        fprintf(stderr, "Error: t_free_sized(%p, %zu) on a block of %zu usable bytes\n", ptr, size, usable);
+        abort();
+    }
+}
+#endif
+
+void t_free_sized(void *ptr, size_t size) {
+    if (ptr == NULL) return;
+    TRACE_LOG(TRACE_FREE, ptr, 0, 0);
+#ifdef TDMM_HARDENED
+    if (!free_claim(ptr)) return;
+#endif
+
+#ifdef TDMM_VERIFY_SIZED_FREE
+    verify_free_size(ptr, size);
+#endif
+
+    // Sizes of at least mmap_threshold were always mapped on their own, whatever their alignment
+    if (size >= mmap_threshold) {
+        direct_free((block_header_t *)((char *)ptr - HEADER_SIZE));
+        return;
+    }
+
+#ifdef TDMM_THREAD_SAFE
+    // A slot's size follows from the size it was requested with, so it is cached
+    // without reading its slab's header, which lives on a cache line of its own
+    if (size > 0 && size <= slab_max_size && slab_contains(ptr)) {
+        size_t slot_size = (size + SLAB_GRANULE - 1) & ~(SLAB_GRANULE - 1);
+        tcache_free(tcache_get(), slot_size / TCACHE_GRANULE - 1, ptr, slot_size);
+        return;
+    }
+#endif
+
+    // Slabs without a thread cache keep their free list in the slab header, and strategy
+    // blocks need their header to find their neighbours, so the size saves nothing more.
+    // Smaller sizes may still be direct mappings of large alignments
+    free_block(ptr);
+}
+
+/**
+ * Header at the start of every bump arena chunk. Chunks are mapped on their own and show
+ * up in the stats, but unlike direct mappings they survive t_init
+ */
+typedef struct bump_chunk {
+    struct bump_chunk *next;
+    char *end;
+} bump_chunk_t;
+
+#define BUMP_CHUNK_HEADER_SIZE ((sizeof(bump_chunk_t) + BLOCK_ALIGN - 1) & ~(BLOCK_ALIGN - 1))
+#define BUMP_ARENA_SIZE ((sizeof(tdmm_arena_t) + BLOCK_ALIGN - 1) & ~(BLOCK_ALIGN - 1))
+
+/**
+ * The arena lives in its first chunk:
+ *
+ *   [ bump_chunk_t | tdmm_arena_t | objects ... ] -> [ bump_chunk_t | objects ... ] -> ...
+ *
+ * Chunks of the standard size are kept across resets and bumped through again in order
+ */
+struct tdmm_arena {
+    bump_chunk_t *current;   // Chunk being bumped, the ones before it on the list are full
+    bump_chunk_t *first;
+    bump_chunk_t *own;       // Chunks of single large requests, unmapped on reset
+    char *bump;
+    size_t chunk_size;
+};
+
+static bump_chunk_t *bump_chunk_map(size_t size) {
+    if (size > SIZE_MAX - BUMP_CHUNK_HEADER_SIZE - PAGE_SIZE) return NULL;
+    size_t length = (BUMP_CHUNK_HEADER_SIZE + size + PAGE_SIZE - 1) & ~(size_t)(PAGE_SIZE - 1);
+    bump_chunk_t *chunk = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (chunk == MAP_FAILED) return NULL;
+    __atomic_add_fetch(&bump_mapped, length, __ATOMIC_RELAXED);
+
+    // The mapping is page rounded, the tail is usable too
+    chunk->next = NULL;
+    chunk->end = (char *)chunk + length;
+    return chunk;
+}
+
+static void bump_chunk_unmap(bump_chunk_t *chunk) {
+    size_t length = (size_t)(chunk->end - (char *)chunk);
+    if (munmap(chunk, length) != 0) return;
+    __atomic_sub_fetch(&bump_mapped, length, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&bump_released, length, __ATOMIC_RELAXED);
+}
+
+tdmm_arena_t *t_arena_create(size_t chunk_size) {
+    if (chunk_size == 0) chunk_size = DEFAULT_BUMP_CHUNK;
+    if (chunk_size > SIZE_MAX - BUMP_ARENA_SIZE) return NULL;
+
+    bump_chunk_t *first = bump_chunk_map(BUMP_ARENA_SIZE + chunk_size);
+    if (first == NULL) return NULL;
+
+    tdmm_arena_t *arena = (tdmm_arena_t *)((char *)first + BUMP_CHUNK_HEADER_SIZE);
+    arena->current = first;
+    arena->first = first;
+    arena->own = NULL;
+    arena->bump = (char *)arena + BUMP_ARENA_SIZE;
+    arena->chunk_size = chunk_size;
+    return arena;
+}
+
+/**
+ * Serves a request the current chunk can't, size is already rounded to BLOCK_ALIGN
+ */
+static void *bump_alloc_slow(tdmm_arena_t *arena, size_t size) {
+    if (size > arena->chunk_size / BUMP_OWN_CHUNK_DIVISOR) {
+        bump_chunk_t *chunk = bump_chunk_map(size);
+        if (chunk == NULL) return NULL;
+        chunk->next = arena->own;
+        arena->own = chunk;
+        return (char *)chunk + BUMP_CHUNK_HEADER_SIZE;
+    }
+
+    // Chunks left over from before a reset are reused before mapping more
+    bump_chunk_t *next = arena->current->next;
+    if (next == NULL) {
+        next = bump_chunk_map(arena->chunk_size);
+        if (next == NULL) return NULL;
+        arena->current->next = next;
+    }
+
+    arena->current = next;
+    void *ptr = (char *)next + BUMP_CHUNK_HEADER_SIZE;
+    arena->bump = (char *)ptr + size;
+    return ptr;
+}
+
+void *t_arena_alloc(tdmm_arena_t *arena, size_t size) {
+    if (size == 0 || size > SIZE_MAX - BLOCK_ALIGN) return NULL;
+    size = (size + BLOCK_ALIGN - 1) & ~(BLOCK_ALIGN - 1);
+
+    if (size <= (size_t)(arena->current->end - arena->bump)) {
+        void *ptr = arena->bump;
+        arena->bump += size;
+        return ptr;
+    }
+
+    return bump_alloc_slow(arena, size);
+}
+
+void t_arena_reset(tdmm_arena_t *arena) {
+    while (arena->own != NULL) {
+        bump_chunk_t *next = arena->own->next;
+        bump_chunk_unmap(arena->own);
+        arena->own = next;
+    }
+
+    arena->current = arena->first;
+    arena->bump = (char *)arena + BUMP_ARENA_SIZE;
+}
+
+void t_arena_destroy(tdmm_arena_t *arena) {
+    if (arena == NULL) return;
+    t_arena_reset(arena);
+
+    // The arena itself goes with the first chunk, so that one is unmapped last
+    bump_chunk_t *chunk = arena->first->next;
+    while (chunk != NULL) {
+        bump_chunk_t *next = chunk->next;
+        bump_chunk_unmap(chunk);
+        chunk = next;
+    }
+    bump_chunk_unmap(arena->first);
+}
+
+/**
+ * A heap of its own: one arena that no thread is bound to, locked on every call.
+ * It has no slabs or direct mappings, all its memory comes from its regions
+ */
+struct tdmm_heap {
+    heap_arena_t arena;
+};
+
+#define HEAP_HANDLE_SIZE ((sizeof(tdmm_heap_t) + PAGE_SIZE - 1) & ~(size_t)(PAGE_SIZE - 1))
+
+tdmm_heap_t *t_heap_create(alloc_strat_e strat, const tdmm_options_t *opts) {
+    tdmm_options_t defaults;
+    if (opts == NULL) {
+        t_default_options(&defaults);
+        opts = &defaults;
+    }
+
+    const strategy_ops_t *ops = strategy_ops(strat);
+    if (ops == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    // The handle is mapped, not allocated, so it outlives any t_init
+    tdmm_heap_t *heap = mmap(NULL, HEAP_HANDLE_SIZE, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (heap == MAP_FAILED) return NULL;
+
+    region_config_t config;
+    region_config_from_options(&config, opts);
+    heap->arena.ops = ops;
+    heap->arena.slab_max_size = 0;
+    heap->arena.index = 0;
+#ifdef TDMM_THREAD_SAFE
+    pthread_mutex_init(&heap->arena.lock, NULL);
+    heap->arena.remote_free_head = NULL;
+    heap->arena.remote_free_bytes = 0;
+    heap->arena.remote_free_count = 0;
+#endif
+    if (arena_init(&heap->arena, &config) != 0) {
+#ifdef TDMM_THREAD_SAFE
+        pthread_mutex_destroy(&heap->arena.lock);
+#endif
+        munmap(heap, HEAP_HANDLE_SIZE);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    return heap;
+}
+
+void *t_heap_malloc(tdmm_heap_t *heap, size_t size) {
+    arena_lock(&heap->arena);
+    void *ptr = arena_malloc(&heap->arena, BLOCK_ALIGN, size);
+    arena_unlock(&heap->arena);
+    return ptr;
+}
+
+void t_heap_free(tdmm_heap_t *heap, void *ptr) {
+    if (ptr == NULL) return;
+#ifdef TDMM_HARDENED
+    if (!free_claim(ptr)) return;
+#endif
+
+    arena_lock(&heap->arena);
+    arena_free(&heap->arena, ptr);
+    arena_unlock(&heap->arena);
+}
+
+void t_heap_destroy(tdmm_heap_t *heap) {
+    if (heap == NULL) return;
+
+    arena_destroy(&heap->arena);
+#ifdef TDMM_THREAD_SAFE
+    pthread_mutex_destroy(&heap->arena.lock);
+#endif
+    munmap(heap, HEAP_HANDLE_SIZE);
+}
+
+// A private heap is initialized as it is created and only ever freed into under its lock
+size_t t_heap_get_total_mapped_memory(tdmm_heap_t *heap) {
+    return arena_get_total_mapped_memory(&heap->arena);
+}
+
+size_t t_heap_get_currently_allocated_memory(tdmm_heap_t *heap) {
+    return arena_get_currently_allocated_memory(&heap->arena);
+}
+
+int t_heap_get_counters(tdmm_heap_t *heap, tdmm_counters_t *counters) {
+    memset(counters, 0, sizeof(*counters));
+#ifdef TDMM_COUNTERS
+    arena_add_counters(&heap->arena, counters);
+    return 0;
+#else
+    (void)heap;
+    errno = ENOTSUP;
+    return -1;
+#endif
 }
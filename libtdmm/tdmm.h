@@ -2,33 +2,405 @@
 #define TDMM_H
 
 #include <stddef.h>
+#include <stdbool.h>
+
+// Alignment of every pointer t_malloc returns, set through the TDMM_ALIGNMENT CMake option
+#ifndef TDMM_ALIGNMENT
+#define TDMM_ALIGNMENT 16
+#endif
 
 typedef enum {
   FIRST_FIT,
   BEST_FIT,
   WORST_FIT,
+  SEGREGATED_FIT,
+  TLSF,
 } alloc_strat_e;
 
 /**
- * Initializes the memory allocator with the given strategy.
+ * Tunables for how the allocator maps and unmaps memory.
+ */
+typedef struct tdmm_options {
+  size_t initial_size;  // Bytes mapped up front for each arena
+  size_t min_chunk;     // Smallest mapping when an arena grows, doubled on each growth up to max_chunk
+  size_t max_chunk;     // Also the largest a region grows by absorbing adjacent mappings
+  size_t reserve_bytes; // Address space reserved per arena and committed contiguously as it grows, 0 for none
+  size_t mmap_threshold; // Requests at least this large get a mapping of their own, unmapped on free, 0 disables
+  size_t slab_max_size;  // Requests up to this size (at most 256) come from headerless slab slots, 0 disables
+  size_t retain_bytes;  // Fully free regions are only unmapped while at least this much stays mapped per arena
+
+  size_t purge_threshold;  // Free blocks at least this large have their pages purged with madvise, 0 disables
+  unsigned decay_ms;       // How long a free block stays committed before it is purged, 0 purges on free
+  bool purge_lazy;         // Use MADV_FREE (reclaimed under memory pressure) instead of MADV_DONTNEED
+} tdmm_options_t;
+
+/**
+ * Fills opts with the defaults used by t_init.
+ *
+ * @param opts The options to fill in.
+ */
+void t_default_options(tdmm_options_t *opts);
+
+/**
+ * Initializes the memory allocator with the given strategy. Calling it again replaces the
+ * heap and unmaps the previous one's regions and direct mappings, none of its blocks may be
+ * used afterwards. Bump arenas and heaps of t_heap_create are left alone.
+ * A library built with TDMM_STRATEGY links only that strategy and refuses every other.
  *
  * @param strat The strategy to use for memory allocation.
+ * @return 0 on success, -1 with errno set to EINVAL if the strategy isn't linked, the current heap is kept,
+ *         or to ENOMEM if the new heap's first region can't be mapped, the previous heap is gone then.
  */
-void t_init(alloc_strat_e strat);
+int t_init(alloc_strat_e strat);
+
+/**
+ * Initializes the memory allocator with the given strategy and options.
+ *
+ * @param strat The strategy to use for memory allocation.
+ * @param opts The options to use, or NULL for the defaults.
+ * @return 0 on success, -1 with errno set to EINVAL or ENOMEM as for t_init.
+ */
+int t_init_with_options(alloc_strat_e strat, const tdmm_options_t *opts);
 
 /**
  * Allocates a block of memory of the given size.
  *
  * @param size The size of the memory block to allocate.
- * @return A pointer to the allocated memory block fails.
+ * @return A pointer to the allocated memory block, aligned to TDMM_ALIGNMENT, or NULL if allocation fails.
  */
 void *t_malloc(size_t size);
 
+/**
+ * Allocates count blocks of the same size with one arena lock. The blocks are carved
+ * next to each other from one free span, so freeing them together merges them back.
+ *
+ * @param size The size of each memory block.
+ * @param count The number of blocks to allocate.
+ * @param out Receives the blocks, room for count pointers.
+ * @return The number of blocks allocated, fewer than count only if memory runs out.
+ */
+size_t t_malloc_batch(size_t size, size_t count, void **out);
+
+/**
+ * Frees count blocks at once. Blocks of one arena take its lock once, and runs of
+ * neighbouring blocks enter the free lists as a single block.
+ *
+ * @param ptrs The blocks to free, NULL entries are skipped. The array is sorted by address in place.
+ * @param count The number of entries in ptrs.
+ */
+void t_free_batch(void **ptrs, size_t count);
+
+/**
+ * Allocates zeroed memory for an array. Memory fresh from the OS is known to be zero
+ * and is not cleared again.
+ *
+ * @param nmemb The number of elements.
+ * @param size The size of each element.
+ * @return A pointer to the zeroed memory block, or NULL if the total size overflows or allocation fails.
+ */
+void *t_calloc(size_t nmemb, size_t size);
+
+/**
+ * Resizes a block, keeping its contents up to the smaller of the two sizes. The block
+ * shrinks in place and grows into free neighbouring memory when it can, huge blocks are
+ * remapped. Only otherwise it is copied to a new block.
+ *
+ * @param ptr The memory block to resize, or NULL to allocate a new one.
+ * @param size The new size, 0 frees ptr.
+ * @return A pointer to the resized memory block, or NULL if allocation fails and ptr is left untouched.
+ */
+void *t_realloc(void *ptr, size_t size);
+
+/**
+ * Allocates a block of memory whose address is a multiple of alignment.
+ * Only the bytes needed to reach the boundary are set aside, the rest of the block is reused.
+ *
+ * @param alignment A power of two, e.g. 64 for a cache line or 4096 for a page.
+ * @param size The size of the memory block to allocate.
+ * @return A pointer to the allocated memory block, or NULL if alignment is invalid or allocation fails.
+ */
+void *t_aligned_alloc(size_t alignment, size_t size);
+
+/**
+ * Like t_aligned_alloc, with the result stored in memptr.
+ *
+ * @param memptr Receives the allocated memory block on success.
+ * @param alignment A power of two and a multiple of sizeof(void *).
+ * @param size The size of the memory block to allocate.
+ * @return 0 on success, EINVAL if alignment is invalid or ENOMEM if allocation fails.
+ */
+int t_posix_memalign(void **memptr, size_t alignment, size_t size);
+
 /**
  * Frees the given memory block.
  *
- * @param ptr The pointer to the memory block to free. This must be a pointer returned by t_malloc.
+ * @param ptr The pointer to the memory block to free. This must be a pointer returned by t_malloc, t_aligned_alloc or t_posix_memalign.
  */
 void t_free(void *ptr);
 
+/**
+ * Frees a block whose size the caller knows, skipping lookups the size makes unnecessary.
+ * A size of at least mmap_threshold unmaps the block without telling it apart from slab
+ * slots first. In thread-safe builds a slab slot goes to the thread cache without reading
+ * its slab's header. Other blocks are freed as by t_free, since their header is needed
+ * either way. Builds with the TDMM_VERIFY_SIZED_FREE CMake option abort if the size
+ * doesn't match the block.
+ *
+ * @param ptr The memory block to free, as for t_free.
+ * @param size The size the block was allocated or last resized with.
+ */
+void t_free_sized(void *ptr, size_t size);
+
+/**
+ * An independent heap with a strategy of its own, next to the global one t_init sets up.
+ * A heap is locked on every call, so threads may share it. Small and huge requests are
+ * served by its strategy like any other, it uses neither slabs nor direct mappings.
+ */
+typedef struct tdmm_heap tdmm_heap_t;
+
+/**
+ * Creates a heap. It is unaffected by t_init and by every other heap.
+ *
+ * @param strat The strategy to use for memory allocation.
+ * @param opts The options to use, or NULL for the defaults. mmap_threshold and slab_max_size are ignored.
+ * @return The heap, or NULL with errno set to ENOMEM if its handle or first region can't be mapped,
+ *         or to EINVAL if the strategy isn't linked.
+ */
+tdmm_heap_t *t_heap_create(alloc_strat_e strat, const tdmm_options_t *opts);
+
+/**
+ * Allocates a block of memory from a heap.
+ *
+ * @param heap The heap to allocate from.
+ * @param size The size of the memory block to allocate.
+ * @return A pointer aligned to TDMM_ALIGNMENT, or NULL if allocation fails.
+ */
+void *t_heap_malloc(tdmm_heap_t *heap, size_t size);
+
+/**
+ * Frees a block of memory back to the heap it came from. It must not be passed to t_free.
+ *
+ * @param heap The heap the block was allocated from.
+ * @param ptr The memory block to free, or NULL.
+ */
+void t_heap_free(tdmm_heap_t *heap, void *ptr);
+
+/**
+ * Destroys a heap, unmapping all of its memory including blocks that were never freed.
+ *
+ * @param heap The heap to destroy, or NULL.
+ */
+void t_heap_destroy(tdmm_heap_t *heap);
+
+/**
+ * @return The bytes the heap currently has mapped from the OS.
+ */
+size_t t_heap_get_total_mapped_memory(tdmm_heap_t *heap);
+
+/**
+ * @return The bytes currently allocated from the heap, including block headers.
+ */
+size_t t_heap_get_currently_allocated_memory(tdmm_heap_t *heap);
+
+/**
+ * A bump allocator for objects that all die together, e.g. the temporaries of one request.
+ * Objects carry no header and are never freed one by one, t_arena_reset frees all of them.
+ * An arena is not locked, only one thread may use it at a time.
+ */
+typedef struct tdmm_arena tdmm_arena_t;
+
+/**
+ * Creates an arena. Its memory is mapped in chunks, which are kept across resets and t_init.
+ *
+ * @param chunk_size The bytes of objects each chunk holds, 0 for the default of 64 KiB.
+ * @return The arena, or NULL if its first chunk can't be mapped.
+ */
+tdmm_arena_t *t_arena_create(size_t chunk_size);
+
+/**
+ * Allocates from an arena by advancing a pointer. The memory must not be passed to t_free.
+ *
+ * @param arena The arena to allocate from.
+ * @param size The size of the memory block to allocate.
+ * @return A pointer aligned to TDMM_ALIGNMENT, or NULL if size is 0 or a chunk can't be mapped.
+ */
+void *t_arena_alloc(tdmm_arena_t *arena, size_t size);
+
+/**
+ * Frees everything allocated from an arena at once, leaving it ready for reuse.
+ *
+ * @param arena The arena to reset.
+ */
+void t_arena_reset(tdmm_arena_t *arena);
+
+/**
+ * Frees an arena along with everything allocated from it and unmaps its chunks.
+ *
+ * @param arena The arena to destroy, or NULL.
+ */
+void t_arena_destroy(tdmm_arena_t *arena);
+
+/**
+ * Purges the pages of every large free block right away instead of waiting for the decay timer.
+ * Decay only advances on t_free and when the heap grows, so an idle program can call this,
+ * e.g. from a housekeeping thread.
+ * The calling thread's cached blocks are returned to their arenas first, so regions that only
+ * they kept in use are unmapped.
+ */
+void t_purge();
+
+/**
+ * @return The bytes currently mapped from the OS.
+ */
+size_t t_get_total_mapped_memory();
+
+/**
+ * @return The total bytes unmapped and handed back to the OS since t_init.
+ */
+size_t t_get_total_released_memory();
+
+/**
+ * @return The bytes currently allocated, including block headers.
+ */
+size_t t_get_currently_allocated_memory();
+
+/**
+ * @return The bytes spent on allocator metadata.
+ */
+size_t t_get_structural_overhead();
+
+/**
+ * Allocator statistics, see t_get_stats.
+ */
+typedef struct tdmm_stats {
+  size_t mapped_bytes;       // As t_get_total_mapped_memory
+  size_t released_bytes;     // As t_get_total_released_memory
+  size_t allocated_bytes;    // As t_get_currently_allocated_memory
+  size_t overhead_bytes;     // As t_get_structural_overhead
+  size_t allocated_blocks;   // Blocks handed out and not freed yet, slab slots and direct mappings included
+  size_t free_blocks;        // Blocks on the arenas' free lists. Blocks parked in thread caches count as neither
+  size_t free_bytes;         // Payload bytes of those blocks
+  size_t largest_free_block; // Payload of the largest of them, the largest request served without mapping more memory
+} tdmm_stats_t;
+
+/**
+ * Fills in every statistic with one pass over the arenas. Malloc and free keep the counters
+ * up to date, so this usually takes constant time per arena instead of walking the heap.
+ * Splitting the largest free block keeps it known. Only once it was allocated whole, or its
+ * remainder shares a histogram bucket with another block, does the next call look up its
+ * successor, scanning the highest non-empty bin for segregated fit and TLSF and the whole
+ * free list for the other strategies, under that arena's lock. Otherwise no lock is taken,
+ * so while other threads allocate the fields may come from slightly different moments.
+ * Blocks freed by a thread bound to another arena count as free bytes only once their
+ * arena frees them, until then they are left out of the allocated totals.
+ *
+ * @param stats The statistics to fill in.
+ */
+void t_get_stats(tdmm_stats_t *stats);
+
+/**
+ * A block visited by t_heap_walk.
+ */
+typedef struct tdmm_block_info {
+  void *ptr;      // Payload
+  size_t size;    // Usable bytes, the slot size for slab slots
+  bool free;      // On a free list. Blocks parked in thread caches are reported as allocated
+  bool slab;      // A slab slot rather than a block of a region
+  unsigned arena; // Arena the block belongs to
+} tdmm_block_info_t;
+
+typedef void (*tdmm_walk_fn)(const tdmm_block_info_t *block, void *arg);
+
+/**
+ * Visits every block of every mapped region and every slab slot in address order. Direct
+ * mappings are not visited, t_get_stats counts them. All arenas stay locked during the walk,
+ * so it stops every other thread's allocations, and the callback must not call the allocator.
+ *
+ * @param walk Called once per block.
+ * @param arg Passed on to walk.
+ */
+void t_heap_walk(tdmm_walk_fn walk, void *arg);
+
+// Buckets of tdmm_fragmentation_report_t.free_histogram, enough for any block size
+#define TDMM_FREE_HISTOGRAM_BUCKETS 47
+
+/**
+ * Where the free memory of the arenas sits.
+ */
+typedef struct tdmm_fragmentation_report {
+  size_t free_histogram[TDMM_FREE_HISTOGRAM_BUCKETS]; // Free blocks by payload, bucket i counts sizes in [2^i, 2^(i+1))
+  size_t free_blocks;            // Blocks on the free lists, as in tdmm_stats_t
+  size_t free_bytes;
+  size_t largest_free_block;
+  double external_fragmentation; // 1 - largest_free_block / free_bytes, the share of free bytes one request can't use
+  size_t num_regions;            // Mappings holding the arenas' blocks
+  size_t region_bytes;           // Bytes of those mappings
+  size_t slab_bytes;             // Bytes of every slab carved
+  size_t slab_allocated_bytes;   // Bytes of the slab slots handed out, thread caches included. The rest of slab_bytes is idle
+} tdmm_fragmentation_report_t;
+
+/**
+ * Fills in a fragmentation report. The histogram is kept up to date by malloc and free like
+ * the counters of t_get_stats, so this costs as much as t_get_stats and is cheap enough to
+ * call periodically. Many free bytes in small buckets with a high external fragmentation
+ * favour another strategy, many regions a larger min_chunk, idle slab bytes a lower slab_max_size.
+ *
+ * @param report The report to fill in.
+ */
+void t_fragmentation_report(tdmm_fragmentation_report_t *report);
+
+/**
+ * Events on the hot paths of a strategy. Every heap counts into one of these, the arenas of
+ * the global heap and each heap of t_heap_create alike.
+ */
+typedef struct tdmm_counters {
+  size_t searches;       // Free-list searches by malloc
+  size_t search_steps;   // Free blocks those searches looked at
+  size_t exact_fits;     // Searches that found a block of exactly the size asked for
+  size_t splits;         // Free blocks split off the tail of an allocated one
+  size_t coalesce_left;  // Freed blocks merged into their free left neighbour
+  size_t coalesce_right; // Freed blocks merged with their free right neighbour
+  size_t grows;          // Times a search came up empty and more memory was mapped
+  size_t grow_bytes;     // Bytes mapped those times
+} tdmm_counters_t;
+
+/**
+ * Sums the counters of every arena of the global heap since t_init. Counts accumulate per
+ * arena rather than per thread: every thread is bound to an arena and counts under the lock it
+ * already holds for the malloc or free, so counting adds no contention and no atomics, and the
+ * arena is the finest unit that sees a whole search. Threads share arenas once there are more
+ * threads than arenas, and the sum covers every arena, so a count can't be attributed to the
+ * thread that caused it. Per-thread figures need that thread alone in its arena. Needs a build configured with -DTDMM_COUNTERS=ON,
+ * without it the hot paths count nothing and this fails with ENOTSUP. Slab slots and direct
+ * mappings bypass the strategies and are not counted.
+ *
+ * @param counters The counters to fill in, zeroed if counting is not built in.
+ * @return 0 on success, -1 without TDMM_COUNTERS.
+ */
+int t_get_counters(tdmm_counters_t *counters);
+
+/**
+ * Fills in the counters of a heap since t_heap_create, as t_get_counters does for the global heap.
+ *
+ * @param heap The heap to read.
+ * @param counters The counters to fill in, zeroed if counting is not built in.
+ * @return 0 on success, -1 without TDMM_COUNTERS.
+ */
+int t_heap_get_counters(tdmm_heap_t *heap, tdmm_counters_t *counters);
+
+/**
+ * Starts logging the allocations, reallocations and frees of the global heap to a binary
+ * trace file, which hw6_replay replays against any strategy. Needs a build configured with
+ * -DTDMM_TRACE=ON, without it nothing is logged and this fails with ENOTSUP.
+ *
+ * @param path The file to create, it is truncated if it exists.
+ * @return 0 on success, -1 if the file can't be created or a trace is already being written.
+ */
+int t_trace_start(const char *path);
+
+/**
+ * Writes out the remaining events and closes the trace file. Does nothing if no trace is open.
+ */
+void t_trace_stop();
+
 #endif // TDMM_H
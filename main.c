@@ -3,16 +3,17 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <errno.h>
+#include <stdint.h>
 #include "libtdmm/tdmm.h"
 #include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
 
 
 // Helper macro for testing
 #define TEST_PRINT(test_name) printf("Running %s...\n", test_name)
 
-extern size_t t_get_total_mapped_memory();
-extern size_t t_get_currently_allocated_memory();
-
 #define NUM_OPERATIONS 10000
 #define MAX_ALLOC_SIZE 4096
 
@@ -22,7 +23,7 @@ typedef struct {
 } alloc_record_t;
 
 void run_comparative_benchmark(alloc_strat_e strat, const char* name, FILE* csv_file) {
-    t_init(strat);
+    if (t_init(strat) != 0) return; // Not linked into this build
     srand(42); // Fixed seed: ensures all policies face the same random cases
 
     alloc_record_t records[NUM_OPERATIONS];
@@ -81,9 +82,38 @@ void run_comparative_benchmark(alloc_strat_e strat, const char* name, FILE* csv_
     printf("  Total Time: %lld ns\n", total_nsec);
     printf("  Average Throughput: %.2f ops/sec\n", (double)NUM_OPERATIONS / (total_nsec / 1e9));
     printf("  Structural Overhead: %zu bytes\n", t_get_structural_overhead());
+
+    // The run ends at its peak, free what is still live to see how much goes back
+    for (int i = 0; i < active_allocs; i++) t_free(records[i].ptr);
+    t_purge();
+    printf("  Released to OS: %zu bytes\n", t_get_total_released_memory());
 }
 
-void run_unit_tests() {
+typedef struct {
+    size_t free_blocks;
+    size_t free_bytes;
+    size_t largest_free;
+    size_t blocks;
+    const char* last;
+    const void* target;
+    bool target_allocated;
+} walk_totals_t;
+
+void count_block(const tdmm_block_info_t* block, void* arg) {
+    walk_totals_t* totals = arg;
+    // Address order across regions and slabs
+    assert((const char*)block->ptr > totals->last);
+    totals->last = block->ptr;
+    totals->blocks++;
+    if (block->ptr == totals->target) totals->target_allocated = !block->free;
+    if (block->free && !block->slab) {
+        totals->free_blocks++;
+        totals->free_bytes += block->size;
+        if (block->size > totals->largest_free) totals->largest_free = block->size;
+    }
+}
+
+void run_unit_tests(alloc_strat_e strat) {
     TEST_PRINT("Test 1: Basic Allocation and Writing");
     void *p1 = t_malloc(16);
     assert(p1 != NULL);
@@ -96,14 +126,46 @@ void run_unit_tests() {
     assert(p2 != NULL && p3 != NULL);
     assert(p1 != p2 && p2 != p3); // Ensure pointers are distinct
 
-    // TEST_PRINT("Test 3: Defensive Programming (Invalid Free)");
-    // // The spec requires catching invalid pointers. This should print your stderr message but NOT crash.
-    // int fake_ptr = 0xDEADBEEF;
-    // t_free(&fake_ptr); 
+#ifdef TDMM_HARDENED
+    TEST_PRINT("Test 3: Defensive Programming (Invalid Free)");
+    // The spec requires catching invalid pointers. This should print your stderr message but NOT crash.
+    int fake_ptr = 0xDEADBEEF;
+    t_free(&fake_ptr);
+    // Pointers into the middle of a block are caught too
+    t_free((char *)p3 + TDMM_ALIGNMENT);
+    // Even behind a header forged inside a live block, whatever its tag bytes hold
+    char *p_forge = t_malloc(1000);
+    assert(p_forge != NULL);
+    size_t allocated_forge = t_get_currently_allocated_memory();
+    size_t real_header = *(size_t *)(p_forge - sizeof(size_t));
+    size_t *forged_header = (size_t *)(p_forge + 4 * TDMM_ALIGNMENT - sizeof(size_t));
+    fflush(stderr);
+    int saved_stderr = dup(STDERR_FILENO);
+    int null_fd = open("/dev/null", O_WRONLY);
+    dup2(null_fd, STDERR_FILENO);
+    for (size_t tag = 0; tag < 256; tag++) {
+        *forged_header = (real_header & ((size_t)0xff << 56)) | (tag << 48) | (2 * TDMM_ALIGNMENT - sizeof(size_t));
+        t_free(p_forge + 4 * TDMM_ALIGNMENT);
+    }
+    fflush(stderr);
+    dup2(saved_stderr, STDERR_FILENO);
+    close(null_fd);
+    close(saved_stderr);
+    assert(t_get_currently_allocated_memory() == allocated_forge);
+    t_free(p_forge);
+    assert(t_get_currently_allocated_memory() < allocated_forge);
 
-    // TEST_PRINT("Test 4: Defensive Programming (Double Free)");
-    // t_free(p2);
-    // t_free(p2); // Should trigger your double-free detection
+    TEST_PRINT("Test 4: Defensive Programming (Double Free)");
+    t_free(p2);
+    t_free(p2); // Should trigger your double-free detection
+    size_t allocated_double = t_get_currently_allocated_memory();
+    void *p_double = t_malloc(1000);
+    t_free(p_double);
+    t_free(p_double);
+    assert(t_get_currently_allocated_memory() == allocated_double);
+#else
+    t_free(p2);
+#endif
 
     TEST_PRINT("Test 5: Coalescing Physical Neighbors");
     // p2 is already free. p1 and p3 surround it. 
@@ -118,36 +180,530 @@ void run_unit_tests() {
     t_free(massive);
 
     TEST_PRINT("Test 6: Heap Expansion");
-    // Request more than the 4096 page size. This forces request_more_memory to trigger.
-    void *p_large1 = t_malloc(5000);
+    // Request more than the initial chunk. This forces request_more_memory to trigger.
+    void *p_large1 = t_malloc(100 * 1024);
     assert(p_large1 != NULL);
     t_free(p_large1);
 
+    TEST_PRINT("Test 9: Headerless Small Objects");
+    // Small objects come from slabs, so they cost far less than a block header each
+    void *small[256];
+    size_t overhead_before = t_get_structural_overhead();
+    for (int i = 0; i < 256; i++) {
+        small[i] = t_malloc(24);
+        assert(small[i] != NULL);
+        memset(small[i], i, 24);
+    }
+    assert(t_get_structural_overhead() - overhead_before < 256 * 8);
+    for (int i = 0; i < 256; i++) {
+        assert(((unsigned char *)small[i])[23] == (unsigned char)i);
+        t_free(small[i]);
+    }
+
+    TEST_PRINT("Test 10: Alignment");
+    // Every block is aligned for any type, whatever the sizes of the blocks before it
+    void *mixed[64];
+    for (int i = 0; i < 64; i++) {
+        mixed[i] = t_malloc(1 + i * 37);
+        assert(mixed[i] != NULL && (uintptr_t)mixed[i] % TDMM_ALIGNMENT == 0);
+    }
+    // Over-aligned blocks give back what they don't need in front of and behind the boundary
+    size_t allocated_before = t_get_currently_allocated_memory();
+    char *p_line = t_aligned_alloc(64, 100);
+    char *p_page = t_aligned_alloc(4096, 5000);
+    assert(p_line != NULL && (uintptr_t)p_line % 64 == 0);
+    assert(p_page != NULL && (uintptr_t)p_page % 4096 == 0);
+    memset(p_line, 1, 100);
+    memset(p_page, 2, 5000);
+    assert(t_get_currently_allocated_memory() - allocated_before < 100 + 5000 + 2 * (128 + 2 * TDMM_ALIGNMENT));
+    void *p_huge = NULL;
+    int memalign_result = t_posix_memalign(&p_huge, 64 * 1024, 1024 * 1024);
+    assert(memalign_result == 0);
+    assert(p_huge != NULL && (uintptr_t)p_huge % (64 * 1024) == 0);
+    void *p_bad = NULL;
+    memalign_result = t_posix_memalign(&p_bad, 24, 64);
+    assert(memalign_result == EINVAL && p_bad == NULL);
+    t_free(p_line);
+    t_free(p_page);
+    t_free(p_huge);
+    for (int i = 0; i < 64; i++) t_free(mixed[i]);
+
+    TEST_PRINT("Test 11: Reallocation");
+    char *p_buf = t_realloc(NULL, 4000);
+    assert(p_buf != NULL);
+    memset(p_buf, 'r', 4000);
+    // Shrinking gives the tail back, growing again takes it over without moving
+    char *p_resized = t_realloc(p_buf, 1000);
+    assert(p_resized == p_buf);
+    p_resized = t_realloc(p_buf, 4000);
+    assert(p_resized == p_buf);
+    assert(p_buf[999] == 'r');
+    // Huge blocks are remapped, the contents come along
+    char *p_map = t_malloc(1024 * 1024);
+    assert(p_map != NULL);
+    memset(p_map, 'm', 1024 * 1024);
+    p_map = t_realloc(p_map, 8 * 1024 * 1024);
+    assert(p_map != NULL && p_map[1024 * 1024 - 1] == 'm');
+    p_map[8 * 1024 * 1024 - 1] = 'm';
+    // Moving between a slab slot and a block keeps the contents too
+    char *p_small = t_malloc(16);
+    memset(p_small, 's', 16);
+    p_small = t_realloc(p_small, 3000);
+    assert(p_small != NULL && p_small[15] == 's');
+    p_small = t_realloc(p_small, 0);
+    assert(p_small == NULL);
+    t_free(p_buf);
+    t_free(p_map);
+
+    TEST_PRINT("Test 12: Zeroed Allocation");
+    // Recycled memory is cleared, whether or not it was fresh the first time
+    for (int round = 0; round < 2; round++) {
+        size_t sizes[] = { 40, 3000, 60000, 1024 * 1024 };
+        for (int i = 0; i < 4; i++) {
+            unsigned char *p_zero = t_calloc(sizes[i] / 8, 8);
+            assert(p_zero != NULL);
+            for (size_t k = 0; k < sizes[i]; k++) assert(p_zero[k] == 0);
+            memset(p_zero, 0xff, sizes[i]);
+            t_free(p_zero);
+        }
+    }
+    assert(t_calloc(SIZE_MAX / 2, 4) == NULL);
+
+    TEST_PRINT("Test 13: Batch Allocation");
+    // Batches come from one span and free back into it, slots and blocks alike
+    size_t batch_sizes[] = { 48, 300 };
+    for (int b = 0; b < 2; b++) {
+        void *nodes[100];
+        size_t allocated_batch = t_get_currently_allocated_memory();
+        size_t batch_count = t_malloc_batch(batch_sizes[b], 100, nodes);
+        assert(batch_count == 100);
+        for (int i = 0; i < 100; i++) {
+            assert(nodes[i] != NULL && (uintptr_t)nodes[i] % TDMM_ALIGNMENT == 0);
+            memset(nodes[i], i, batch_sizes[b]);
+        }
+        for (int i = 0; i < 100; i++) assert(((unsigned char *)nodes[i])[batch_sizes[b] - 1] == i);
+        t_free_batch(nodes, 100);
+        assert(t_get_currently_allocated_memory() == allocated_batch);
+    }
+
+    TEST_PRINT("Test 14: Sized Free");
+    // Freeing with the requested size gives back exactly what plain free would: slab slots,
+    // strategy blocks and a direct mapping, which the size alone sends back to the OS
+    size_t sized[] = { 1, 16, 100, 256, 1000, 60000, 1024 * 1024 };
+    void *p_sized[7];
+    size_t allocated_sized = t_get_currently_allocated_memory();
+    tdmm_stats_t stats_sized;
+    t_get_stats(&stats_sized);
+    for (int i = 0; i < 7; i++) {
+        p_sized[i] = t_malloc(sized[i]);
+        assert(p_sized[i] != NULL);
+        memset(p_sized[i], 's', sized[i]);
+    }
+    // Resized blocks are freed with their new size
+    p_sized[4] = t_realloc(p_sized[4], 2000);
+    sized[4] = 2000;
+    // A small block of a large alignment is a direct mapping too
+    void *p_sized_aligned = t_aligned_alloc(1024 * 1024, 64);
+    assert(p_sized_aligned != NULL && (uintptr_t)p_sized_aligned % (1024 * 1024) == 0);
+    for (int i = 0; i < 6; i++) t_free_sized(p_sized[i], sized[i]);
+    size_t mapped_sized = t_get_total_mapped_memory();
+    t_free_sized(p_sized[6], sized[6]);
+    assert(t_get_total_mapped_memory() <= mapped_sized - 1024 * 1024);
+    mapped_sized = t_get_total_mapped_memory();
+    t_free_sized(p_sized_aligned, 64);
+    assert(t_get_total_mapped_memory() < mapped_sized);
+    t_free_sized(NULL, 0);
+    assert(t_get_currently_allocated_memory() == allocated_sized);
+    size_t blocks_sized = stats_sized.allocated_blocks;
+    t_get_stats(&stats_sized);
+    assert(stats_sized.allocated_blocks == blocks_sized);
+
+    TEST_PRINT("Test 15: Bump Arena");
+    // Objects are packed back to back, a reset hands the same memory out again
+    size_t mapped_arena = t_get_total_mapped_memory();
+    tdmm_arena_t *scratch = t_arena_create(4096);
+    assert(scratch != NULL);
+    char *p_first = t_arena_alloc(scratch, 24);
+    char *p_prev = p_first;
+    for (int i = 0; i < 1000; i++) {
+        char *p_obj = t_arena_alloc(scratch, 40);
+        assert(p_obj != NULL && (uintptr_t)p_obj % TDMM_ALIGNMENT == 0);
+        memset(p_obj, i, 40);
+        p_prev = p_obj;
+    }
+    assert(p_prev[39] == (char)999);
+    char *p_large = t_arena_alloc(scratch, 100000);
+    assert(p_large != NULL);
+    memset(p_large, 'l', 100000);
+    char *p_empty = t_arena_alloc(scratch, 0);
+    assert(p_empty == NULL);
+    t_arena_reset(scratch);
+    char *p_reused = t_arena_alloc(scratch, 24);
+    assert(p_reused == p_first);
+    t_arena_destroy(scratch);
+    assert(t_get_total_mapped_memory() == mapped_arena);
+
+    TEST_PRINT("Test 16: Independent Heaps");
+    // Heaps with their own strategies leave the global heap and each other alone
+    size_t allocated_global = t_get_currently_allocated_memory();
+    size_t mapped_global = t_get_total_mapped_memory();
+    tdmm_heap_t *heap_a = t_heap_create(strat, NULL);
+    tdmm_heap_t *heap_b = t_heap_create(TLSF, NULL);
+    // A single strategy build refuses TLSF unless it is the one linked
+    if (heap_b == NULL) heap_b = t_heap_create(strat, NULL);
+    assert(heap_a != NULL && heap_b != NULL);
+    void *p_heap_a[50];
+    void *p_heap_b[50];
+    for (int i = 0; i < 50; i++) {
+        p_heap_a[i] = t_heap_malloc(heap_a, 100 + i * 10);
+        p_heap_b[i] = t_heap_malloc(heap_b, 16);
+        assert(p_heap_a[i] != NULL && p_heap_b[i] != NULL);
+        memset(p_heap_a[i], 'a', 100 + i * 10);
+        memset(p_heap_b[i], 'b', 16);
+    }
+    void *p_heap_huge = t_heap_malloc(heap_a, 1024 * 1024);
+    assert(p_heap_huge != NULL);
+    assert(t_heap_get_currently_allocated_memory(heap_a) > 1024 * 1024);
+    for (int i = 0; i < 50; i++) t_heap_free(heap_b, p_heap_b[i]);
+    assert(t_heap_get_currently_allocated_memory(heap_b) == 0);
+    assert(t_get_currently_allocated_memory() == allocated_global);
+    assert(t_get_total_mapped_memory() == mapped_global);
+    // Destroying a heap reclaims the blocks still allocated from it
+    t_heap_destroy(heap_a);
+    t_heap_destroy(heap_b);
+
+    TEST_PRINT("Test 17: Stats Snapshot");
+    // The snapshot agrees with the single getters and follows blocks in and out of the free lists
+    tdmm_stats_t stats_before, stats_after;
+    t_get_stats(&stats_before);
+    assert(stats_before.mapped_bytes == t_get_total_mapped_memory());
+    assert(stats_before.allocated_bytes == t_get_currently_allocated_memory());
+    assert(stats_before.overhead_bytes == t_get_structural_overhead());
+    assert(stats_before.largest_free_block <= stats_before.free_bytes);
+    void *p_stats = t_malloc(20000);
+    assert(p_stats != NULL);
+    t_get_stats(&stats_after);
+    assert(stats_after.allocated_blocks == stats_before.allocated_blocks + 1);
+    assert(stats_after.allocated_bytes >= stats_before.allocated_bytes + 20000);
+    t_free(p_stats);
+    t_get_stats(&stats_after);
+    assert(stats_after.allocated_blocks == stats_before.allocated_blocks);
+    assert(stats_after.largest_free_block >= 20000);
+
+#ifdef TDMM_TRACE
+    TEST_PRINT("Test 18: Trace Recording");
+    // Each call of the API is one event, calls the API makes itself are not logged again
+    const char *trace_path = "trace_test.bin";
+    int trace_result = t_trace_start(trace_path);
+    assert(trace_result == 0);
+    trace_result = t_trace_start(trace_path);
+    assert(trace_result == -1);
+    void *p_trace = t_malloc(100);
+    p_trace = t_realloc(p_trace, 5000);
+    void *p_trace_zeroed = t_calloc(10, 10);
+    t_free(p_trace);
+    t_free(p_trace_zeroed);
+    t_trace_stop();
+    FILE *trace_file = fopen(trace_path, "rb");
+    assert(trace_file != NULL);
+    fseek(trace_file, 0, SEEK_END);
+    assert(ftell(trace_file) == 16 + 5 * 32);
+    fclose(trace_file);
+    remove(trace_path);
+#endif
+
+    TEST_PRINT("Test 19: Heap Walk and Fragmentation Report");
+    // The walk finds every free block the report counts, and the blocks in use
+    void* p_walk = t_malloc(3000);
+    void* p_walk_small = t_malloc(32);
+    assert(p_walk != NULL && p_walk_small != NULL);
+    walk_totals_t totals;
+    memset(&totals, 0, sizeof(totals));
+    totals.target = p_walk;
+    t_heap_walk(count_block, &totals);
+    tdmm_fragmentation_report_t report;
+    t_fragmentation_report(&report);
+    assert(totals.target_allocated);
+    assert(totals.free_blocks == report.free_blocks);
+    assert(totals.free_bytes == report.free_bytes);
+    assert(totals.largest_free == report.largest_free_block);
+    size_t histogram_blocks = 0;
+    for (int i = 0; i < TDMM_FREE_HISTOGRAM_BUCKETS; i++) histogram_blocks += report.free_histogram[i];
+    assert(histogram_blocks == report.free_blocks);
+    assert(report.num_regions > 0);
+    assert(report.external_fragmentation >= 0.0 && report.external_fragmentation < 1.0);
+    assert(report.largest_free_block <= report.free_bytes);
+    t_free(p_walk);
+    t_free(p_walk_small);
+
+#ifdef TDMM_COUNTERS
+    TEST_PRINT("Test 20: Hot-Path Counters");
+    // A malloc is one search and splits its block, freeing it merges the tail back
+    tdmm_counters_t counters_before, counters_after;
+    int counters_result = t_get_counters(&counters_before);
+    assert(counters_result == 0);
+    void* p_count = t_malloc(5000);
+    assert(p_count != NULL);
+    t_get_counters(&counters_after);
+    assert(counters_after.searches == counters_before.searches + 1);
+    assert(counters_after.splits + counters_after.exact_fits > counters_before.splits + counters_before.exact_fits);
+    t_free(p_count);
+    t_get_counters(&counters_after);
+    assert(counters_after.coalesce_left + counters_after.coalesce_right >
+           counters_before.coalesce_left + counters_before.coalesce_right);
+
+    // A heap of its own counts apart from the global heap
+    tdmm_heap_t* heap_count = t_heap_create(strat, NULL);
+    assert(heap_count != NULL);
+    tdmm_counters_t heap_counters;
+    counters_result = t_heap_get_counters(heap_count, &heap_counters);
+    assert(counters_result == 0);
+    assert(heap_counters.searches == 0 && heap_counters.grows == 0);
+    t_get_counters(&counters_before);
+    void* p_heap_count = t_heap_malloc(heap_count, 5000);
+    assert(p_heap_count != NULL);
+    t_heap_get_counters(heap_count, &heap_counters);
+    assert(heap_counters.searches == 1);
+    t_get_counters(&counters_after);
+    assert(counters_after.searches == counters_before.searches);
+    t_heap_free(heap_count, p_heap_count);
+    t_heap_destroy(heap_count);
+#endif
+
+    TEST_PRINT("Test 21: TLSF Small Size Lists");
+    // Every small list holds one payload size, so a freed block is only reused by requests
+    // it fits. Lists coarser than TDMM_ALIGNMENT used to hand back a block 8 bytes short
+    tdmm_heap_t* heap_tlsf = t_heap_create(TLSF, NULL);
+    // Refused only by single strategy builds of another strategy
+    assert(heap_tlsf != NULL || (strat != TLSF && errno == EINVAL));
+    for (size_t size = 8; heap_tlsf != NULL && size <= 512; size += 8) {
+        char* p_first = t_heap_malloc(heap_tlsf, size);
+        char* p_second = t_heap_malloc(heap_tlsf, size);
+        assert(p_first != NULL && p_second != NULL);
+        t_heap_free(heap_tlsf, p_first);
+        char* p_larger = t_heap_malloc(heap_tlsf, size + 8);
+        assert(p_larger != NULL);
+        memset(p_larger, 0xa5, size + 8);
+        t_heap_free(heap_tlsf, p_second);
+        t_heap_free(heap_tlsf, p_larger);
+        assert(t_heap_get_currently_allocated_memory(heap_tlsf) == 0);
+    }
+    if (heap_tlsf != NULL) t_heap_destroy(heap_tlsf);
+
+    TEST_PRINT("Test 22: Largest Free Block After Splits");
+    // Most mallocs split the largest block, the stats follow it without walking the lists
+    void* p_split[64];
+    for (int i = 0; i < 64; i++) {
+        p_split[i] = t_malloc(1000 + i * 328);
+        assert(p_split[i] != NULL);
+        if (i % 8 != 0) continue;
+        memset(&totals, 0, sizeof(totals));
+        t_heap_walk(count_block, &totals);
+        t_get_stats(&stats_after);
+        assert(stats_after.largest_free_block == totals.largest_free);
+    }
+    // Holes of many sizes, then more splits that may or may not take the largest
+    for (int i = 0; i < 64; i += 2) t_free(p_split[i]);
+    for (int i = 0; i < 64; i += 2) {
+        p_split[i] = t_malloc(700 + i * 97);
+        assert(p_split[i] != NULL);
+        memset(&totals, 0, sizeof(totals));
+        t_heap_walk(count_block, &totals);
+        t_get_stats(&stats_after);
+        assert(stats_after.largest_free_block == totals.largest_free);
+    }
+    for (int i = 0; i < 64; i++) t_free(p_split[i]);
+
     printf("All Unit Tests Passed for current strategy!\n\n");
 }
 
+/**
+ * Returns the process's mapped address space
+ */
+long vm_size_kb() {
+    long pages = 0;
+    FILE* statm = fopen("/proc/self/statm", "r");
+    if (statm == NULL) return 0;
+    if (fscanf(statm, "%ld", &pages) != 1) pages = 0;
+    fclose(statm);
+    return pages * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+void run_release_test(alloc_strat_e strat) {
+    TEST_PRINT("Test 7: Returning Memory to the OS");
+    // A fresh heap that keeps nothing in reserve, so the region is unmapped once everything in it is freed
+    tdmm_options_t opts;
+    t_default_options(&opts);
+    opts.retain_bytes = 0;
+    t_init_with_options(strat, &opts);
+
+    // Both stay under the direct mapping threshold, the heap has to grow for them
+    size_t mapped_before = t_get_total_mapped_memory();
+    void *p_big1 = t_malloc(96 * 1024);
+    void *p_big2 = t_malloc(96 * 1024);
+    assert(p_big1 != NULL && p_big2 != NULL);
+    t_free(p_big1);
+    t_free(p_big2);
+    assert(t_get_total_released_memory() >= 192 * 1024);
+    assert(t_get_total_mapped_memory() <= mapped_before);
+
+    TEST_PRINT("Test 8: Direct Mapping of Huge Allocations");
+    mapped_before = t_get_total_mapped_memory();
+    size_t released_before = t_get_total_released_memory();
+    char *p_huge = t_malloc(4 * 1024 * 1024);
+    assert(p_huge != NULL);
+    p_huge[4 * 1024 * 1024 - 1] = 'x';
+    assert(t_get_total_mapped_memory() >= mapped_before + 4 * 1024 * 1024);
+    t_free(p_huge);
+    assert(t_get_total_released_memory() - released_before >= 4 * 1024 * 1024);
+    assert(t_get_total_mapped_memory() <= mapped_before);
+
+    TEST_PRINT("Test 23: Replacing a Heap With Live Huge Blocks");
+    // t_init unmaps direct mappings left live, bump arena chunks survive it and keep their own stats
+    tdmm_arena_t *scratch = t_arena_create(0);
+    assert(scratch != NULL);
+    char *p_kept = t_arena_alloc(scratch, 64);
+    assert(p_kept != NULL);
+    long vm_before = vm_size_kb();
+    void *p_left_live = t_malloc(64 * 1024 * 1024);
+    assert(p_left_live != NULL);
+    t_init_with_options(strat, &opts);
+    assert(vm_size_kb() < vm_before + 32 * 1024);
+    memset(p_kept, 'k', 64);
+    mapped_before = t_get_total_mapped_memory();
+    t_arena_destroy(scratch);
+    assert(t_get_total_mapped_memory() < mapped_before);
+
+    TEST_PRINT("Test 24: Releasing a Merged Middle Chunk");
+    // Mappings land next to each other and merge, freeing what was allocated in between
+    // still frees whole regions while the blocks on both sides stay live
+    t_init(strat);
+    void *p_phases[3][64];
+    for (int phase = 0; phase < 3; phase++) {
+        for (int i = 0; i < 64; i++) {
+            p_phases[phase][i] = t_malloc(48 * 1024);
+            assert(p_phases[phase][i] != NULL);
+        }
+    }
+    released_before = t_get_total_released_memory();
+    for (int i = 0; i < 64; i++) t_free(p_phases[1][i]);
+    assert(t_get_total_released_memory() > released_before);
+    for (int i = 0; i < 64; i++) {
+        t_free(p_phases[0][i]);
+        t_free(p_phases[2][i]);
+    }
+
+    TEST_PRINT("Test 25: Shrinking After a Peak");
+    // With the default options only retain_bytes and the region that would cross it stay mapped
+    t_init(strat);
+    tdmm_options_t defaults;
+    t_default_options(&defaults);
+    mapped_before = t_get_total_mapped_memory();
+    released_before = t_get_total_released_memory();
+    void *p_peak[256];
+    for (int i = 0; i < 256; i++) {
+        p_peak[i] = t_malloc(40 * 1024);
+        assert(p_peak[i] != NULL);
+    }
+    size_t mapped_peak = t_get_total_mapped_memory();
+    assert(mapped_peak >= mapped_before + 256 * 40 * 1024);
+    for (int i = 0; i < 256; i++) t_free(p_peak[i]);
+    assert(t_get_total_mapped_memory() <= mapped_before + defaults.retain_bytes + defaults.max_chunk);
+    assert(t_get_total_released_memory() - released_before >= mapped_peak - mapped_before - defaults.retain_bytes - defaults.max_chunk);
+
+    TEST_PRINT("Test 26: Refusing a Heap Without Memory");
+    // A first region no mmap can satisfy fails the heap instead of handing out an empty one
+    tdmm_options_t opts_unmappable = defaults;
+    opts_unmappable.initial_size = (size_t)1 << 60;
+    errno = 0;
+    tdmm_heap_t *heap_unmappable = t_heap_create(strat, &opts_unmappable);
+    assert(heap_unmappable == NULL && errno == ENOMEM);
+    errno = 0;
+    int init_result = t_init_with_options(strat, &opts_unmappable);
+    assert(init_result == -1 && errno == ENOMEM);
+    init_result = t_init(strat);
+    assert(init_result == 0);
+    void *p_after = t_malloc(100);
+    assert(p_after != NULL);
+    t_free(p_after);
+
+    TEST_PRINT("Test 27: Decaying Between Small Frees");
+    // A dirty block is purged within two decay periods even if only small blocks are freed after it
+    tdmm_options_t opts_decay = defaults;
+    opts_decay.decay_ms = 10;
+    opts_decay.retain_bytes = (size_t)1 << 30;
+    init_result = t_init_with_options(strat, &opts_decay);
+    assert(init_result == 0);
+    char *p_dirty = t_malloc(96 * 1024);
+    assert(p_dirty != NULL);
+    memset(p_dirty, 0xab, 96 * 1024);
+    void *p_small[256];
+    for (int i = 0; i < 256; i++) {
+        p_small[i] = t_malloc(2048);
+        assert(p_small[i] != NULL);
+    }
+    // Purged pages read back as zeros, the payload held 0xab before
+    volatile unsigned char *dirty_page = (unsigned char *)(((uintptr_t)p_dirty + 8192) & ~(uintptr_t)4095);
+    t_free(p_dirty);
+    for (int round = 0; round < 2; round++) {
+        struct timespec decay_wait = {0, 20 * 1000 * 1000};
+        nanosleep(&decay_wait, NULL);
+        // Every third block stays live, so none of the freed ones coalesce into a purgeable block.
+        // Nor are the ones near the dirty block freed, merging with it would dirty it again
+        for (int i = round; i < 256; i += 3) {
+            uintptr_t small = (uintptr_t)p_small[i];
+            if (small + 16 * 1024 > (uintptr_t)p_dirty && small < (uintptr_t)p_dirty + (96 + 16) * 1024) continue;
+            t_free(p_small[i]);
+            p_small[i] = NULL;
+        }
+    }
+    assert(dirty_page[0] == 0);
+    for (int i = 0; i < 256; i++) t_free(p_small[i]);
+
+    printf("Release Test Passed for current strategy!\n\n");
+}
+
+/**
+ * Runs every test on a fresh heap of the strategy. Single strategy builds (TDMM_STRATEGY)
+ * refuse the other strategies, those are skipped
+ */
+void run_strategy_tests(alloc_strat_e strat) {
+    if (t_init(strat) != 0) {
+        assert(errno == EINVAL);
+        printf("Not linked into this build, skipped\n\n");
+        return;
+    }
+    run_unit_tests(strat);
+    run_release_test(strat);
+}
+
 int main(int argc, char *argv[]) {
     printf("========================================\n");
     printf("Testing FIRST_FIT Policy\n");
     printf("========================================\n");
-    t_init(FIRST_FIT);
-    run_unit_tests();
+    run_strategy_tests(FIRST_FIT);
     
-    // Note: Since we don't have a t_cleanup to unmap memory, running the other policies
-    // in the exact same process run will just append memory to the existing heap. 
-    // For pure unit testing, it's safe enough.
+    // Every policy starts from a fresh heap, t_init unmaps the previous one
     
     printf("========================================\n");
     printf("Testing BEST_FIT Policy\n");
     printf("========================================\n");
-    t_init(BEST_FIT);
-    run_unit_tests();
+    run_strategy_tests(BEST_FIT);
 
     printf("========================================\n");
     printf("Testing WORST_FIT Policy\n");
     printf("========================================\n");
-    t_init(WORST_FIT);
-    run_unit_tests();
+    run_strategy_tests(WORST_FIT);
+
+    printf("========================================\n");
+    printf("Testing SEGREGATED_FIT Policy\n");
+    printf("========================================\n");
+    run_strategy_tests(SEGREGATED_FIT);
+
+    printf("========================================\n");
+    printf("Testing TLSF Policy\n");
+    printf("========================================\n");
+    run_strategy_tests(TLSF);
 
     printf("Testing complete. Allocator is structurally sound.\n");
     FILE* csv = fopen("throughput.csv", "w");
@@ -156,6 +712,8 @@ int main(int argc, char *argv[]) {
     run_comparative_benchmark(FIRST_FIT, "FIRST_FIT", csv);
     run_comparative_benchmark(BEST_FIT, "BEST_FIT", csv);
     run_comparative_benchmark(WORST_FIT, "WORST_FIT", csv);
+    run_comparative_benchmark(SEGREGATED_FIT, "SEGREGATED_FIT", csv);
+    run_comparative_benchmark(TLSF, "TLSF", csv);
 
     fclose(csv);
     printf("\nThroughput data saved to throughput.csv\n");
@@ -0,0 +1,588 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "libtdmm/tdmm.h"
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Allocator benchmark suite. Every workload runs once per allocator, glibc malloc included
+// as the baseline, each in a child process of its own so the peak RSS belongs to that run alone.
+// Single operations are timed with the cycle counter and binned into log-linear histograms,
+// from which the p50, p99 and p99.9 latencies are read.
+//
+// Usage: hw6_bench [glibc|first_fit|best_fit|worst_fit|segregated_fit|tlsf ...], all by default.
+// Writes one line per run to bench.csv and the latency histograms to bench_histogram.csv.
+
+#define MAX_THREADS 8
+
+// 16 sub-buckets per power of two, so a percentile is off by at most 1/16
+#define HIST_SUB_BITS 4
+#define HIST_SUB_COUNT (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS (HIST_SUB_COUNT + (64 - HIST_SUB_BITS) * HIST_SUB_COUNT)
+
+#define CHURN_SLOTS 4096
+#define CHURN_OPS 400000
+#define LARSON_SLOTS 1000
+#define LARSON_ROUNDS 20
+#define LARSON_OPS_PER_ROUND 10000
+#define QUEUE_SIZE 1024
+#define QUEUE_OBJECTS 200000
+// How often a thread adds up the live bytes of all threads for the peak
+#define LIVE_SAMPLE_INTERVAL 256
+
+typedef struct {
+    uint64_t counts[HIST_BUCKETS];
+} histogram_t;
+
+typedef struct {
+    const char *name;
+    int strat;  // alloc_strat_e, -1 for glibc
+} allocator_t;
+
+static const allocator_t allocators[] = {
+    {"glibc", -1},
+    {"first_fit", FIRST_FIT},
+    {"best_fit", BEST_FIT},
+    {"worst_fit", WORST_FIT},
+    {"segregated_fit", SEGREGATED_FIT},
+    {"tlsf", TLSF},
+};
+#define NUM_ALLOCATORS (sizeof(allocators) / sizeof(allocators[0]))
+
+typedef struct {
+    histogram_t malloc_hist;
+    histogram_t free_hist;
+    uint64_t rng;
+    uint64_t ops;
+    long long live;  // Requested bytes this thread allocated minus those it freed, others read it
+    unsigned index;
+} thread_ctx_t;
+
+typedef struct {
+    const char *name;
+    void (*run)(unsigned num_threads);
+    bool threaded;
+} workload_t;
+
+// What a child process reports back, the parent adds the peak RSS
+typedef struct {
+    histogram_t malloc_hist;
+    histogram_t free_hist;
+    uint64_t ops;
+    double seconds;
+    long long peak_live;
+    long baseline_rss_kb;
+} bench_result_t;
+
+static const allocator_t *allocator;
+static thread_ctx_t contexts[MAX_THREADS];
+static unsigned active_threads;
+static long long peak_live;
+
+static double ns_per_cycle = 1.0;
+static uint64_t timer_overhead;
+
+#if defined(__x86_64__) || defined(__i386__)
+static inline uint64_t cycles_now() {
+    return __rdtsc();
+}
+#else
+static inline uint64_t cycles_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+#endif
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Measures the cycle counter against the monotonic clock, and what reading it twice costs
+ */
+static void calibrate_timer() {
+    double start_s = now_seconds();
+    uint64_t start = cycles_now();
+    while (now_seconds() - start_s < 0.05) {}
+    ns_per_cycle = (now_seconds() - start_s) * 1e9 / (double)(cycles_now() - start);
+
+    timer_overhead = UINT64_MAX;
+    for (int i = 0; i < 10000; i++) {
+        uint64_t t0 = cycles_now();
+        uint64_t t1 = cycles_now();
+        if (t1 - t0 < timer_overhead) timer_overhead = t1 - t0;
+    }
+}
+
+static unsigned hist_index(uint64_t value) {
+    if (value < HIST_SUB_COUNT) return (unsigned)value;
+    unsigned log2 = 63 - (unsigned)__builtin_clzll(value);
+    unsigned shift = log2 - HIST_SUB_BITS;
+    return HIST_SUB_COUNT + shift * HIST_SUB_COUNT + (unsigned)((value >> shift) & (HIST_SUB_COUNT - 1));
+}
+
+/**
+ * Returns the largest value that lands in bucket idx
+ */
+static uint64_t hist_bucket_max(unsigned idx) {
+    if (idx < HIST_SUB_COUNT) return idx;
+    unsigned shift = (idx - HIST_SUB_COUNT) / HIST_SUB_COUNT;
+    uint64_t sub = (idx - HIST_SUB_COUNT) % HIST_SUB_COUNT;
+    return ((HIST_SUB_COUNT + sub + 1) << shift) - 1;
+}
+
+static void hist_record(histogram_t *hist, uint64_t cycles) {
+    hist->counts[hist_index(cycles > timer_overhead ? cycles - timer_overhead : 0)]++;
+}
+
+static void hist_merge(histogram_t *into, const histogram_t *from) {
+    for (unsigned i = 0; i < HIST_BUCKETS; i++) into->counts[i] += from->counts[i];
+}
+
+/**
+ * Returns the latency in ns below which a fraction q of the samples lie
+ */
+static double hist_percentile(const histogram_t *hist, double q) {
+    uint64_t total = 0;
+    for (unsigned i = 0; i < HIST_BUCKETS; i++) total += hist->counts[i];
+    if (total == 0) return 0;
+
+    uint64_t rank = (uint64_t)ceil(q * (double)total);
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < HIST_BUCKETS; i++) {
+        seen += hist->counts[i];
+        if (seen >= rank) return hist_bucket_max(i) * ns_per_cycle;
+    }
+    return hist_bucket_max(HIST_BUCKETS - 1) * ns_per_cycle;
+}
+
+static uint64_t rng_next(thread_ctx_t *ctx) {
+    // xorshift64*
+    ctx->rng ^= ctx->rng >> 12;
+    ctx->rng ^= ctx->rng << 25;
+    ctx->rng ^= ctx->rng >> 27;
+    return ctx->rng * 0x2545F4914F6CDD1Dull;
+}
+
+static double rng_unit(thread_ctx_t *ctx) {
+    return (double)(rng_next(ctx) >> 11) / (double)(1ull << 53);
+}
+
+static size_t size_fixed(thread_ctx_t *ctx) {
+    (void)ctx;
+    return 64;
+}
+
+/**
+ * Pareto distributed sizes from 16 bytes to 64 KiB: most requests are small, a few are huge
+ */
+static size_t size_power_law(thread_ctx_t *ctx) {
+    double size = 16.0 / pow(1.0 - rng_unit(ctx), 1.0 / 1.1);
+    return size > 65536.0 ? 65536 : (size_t)size;
+}
+
+/**
+ * 90% small objects of 16 to 128 bytes, 10% buffers of 8 to 64 KiB
+ */
+static size_t size_bimodal(thread_ctx_t *ctx) {
+    if (rng_next(ctx) % 10 != 0) return 16 + rng_next(ctx) % 113;
+    return 8192 + rng_next(ctx) % (65536 - 8192 + 1);
+}
+
+static size_t size_larson(thread_ctx_t *ctx) {
+    return 16 + rng_next(ctx) % (1024 - 16 + 1);
+}
+
+static void *bench_malloc(size_t size) {
+    return allocator->strat < 0 ? malloc(size) : t_malloc(size);
+}
+
+static void bench_free(void *ptr) {
+    if (allocator->strat < 0) free(ptr);
+    else t_free(ptr);
+}
+
+/**
+ * Adds up the live bytes of every thread and raises the peak. Racy reads of the other
+ * threads only blur the peak a little
+ */
+static void sample_live() {
+    long long live = 0;
+    for (unsigned i = 0; i < active_threads; i++) live += __atomic_load_n(&contexts[i].live, __ATOMIC_RELAXED);
+
+    long long peak = __atomic_load_n(&peak_live, __ATOMIC_RELAXED);
+    while (live > peak && !__atomic_compare_exchange_n(&peak_live, &peak, live, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {}
+}
+
+static void account(thread_ctx_t *ctx, long long delta) {
+    __atomic_store_n(&ctx->live, ctx->live + delta, __ATOMIC_RELAXED);
+    if (++ctx->ops % LIVE_SAMPLE_INTERVAL == 0) sample_live();
+}
+
+/**
+ * Allocates and touches every byte, only the allocation is timed
+ */
+static void *timed_malloc(thread_ctx_t *ctx, size_t size) {
+    uint64_t start = cycles_now();
+    void *ptr = bench_malloc(size);
+    hist_record(&ctx->malloc_hist, cycles_now() - start);
+
+    if (ptr == NULL) {
+        fprintf(stderr, "Error: %s ran out of memory\n", allocator->name);
+        exit(1);
+    }
+    memset(ptr, 0xab, size);
+    account(ctx, (long long)size);
+    return ptr;
+}
+
+static void timed_free(thread_ctx_t *ctx, void *ptr, size_t size) {
+    uint64_t start = cycles_now();
+    bench_free(ptr);
+    hist_record(&ctx->free_hist, cycles_now() - start);
+    account(ctx, -(long long)size);
+}
+
+typedef struct {
+    void *ptr;
+    size_t size;
+} slot_t;
+
+// Bookkeeping is static and touched before the run starts, so the allocator under test
+// is the only one whose memory shows up in the run's RSS
+static slot_t churn_slots[CHURN_SLOTS];
+static slot_t larson_slots[MAX_THREADS][LARSON_SLOTS];
+
+/**
+ * One thread picks random slots, freeing full ones and filling empty ones, which keeps
+ * about half of the slots live
+ */
+static void run_churn(size_t (*next_size)(thread_ctx_t *)) {
+    thread_ctx_t *ctx = &contexts[0];
+    slot_t *slots = churn_slots;
+
+    for (int i = 0; i < CHURN_OPS; i++) {
+        slot_t *slot = &slots[rng_next(ctx) % CHURN_SLOTS];
+        if (slot->ptr) {
+            timed_free(ctx, slot->ptr, slot->size);
+            slot->ptr = NULL;
+        }
+        else {
+            slot->size = next_size(ctx);
+            slot->ptr = timed_malloc(ctx, slot->size);
+        }
+    }
+
+    for (int i = 0; i < CHURN_SLOTS; i++) {
+        if (slots[i].ptr) timed_free(ctx, slots[i].ptr, slots[i].size);
+    }
+}
+
+static void run_fixed(unsigned num_threads) {
+    (void)num_threads;
+    run_churn(size_fixed);
+}
+
+static void run_power_law(unsigned num_threads) {
+    (void)num_threads;
+    run_churn(size_power_law);
+}
+
+static void run_bimodal(unsigned num_threads) {
+    (void)num_threads;
+    run_churn(size_bimodal);
+}
+
+static pthread_barrier_t larson_barrier;
+static unsigned larson_threads;
+
+/**
+ * A server in the style of Larson and Krishnan: each thread replaces random objects of its
+ * slot array, and after every round the arrays move on to the next thread, which frees
+ * objects allocated by another
+ */
+static void *larson_worker(void *arg) {
+    thread_ctx_t *ctx = arg;
+
+    slot_t *own = larson_slots[ctx->index];
+    for (int i = 0; i < LARSON_SLOTS; i++) {
+        own[i].size = size_larson(ctx);
+        own[i].ptr = timed_malloc(ctx, own[i].size);
+    }
+    pthread_barrier_wait(&larson_barrier);
+
+    slot_t *slots = own;
+    for (unsigned round = 0; round < LARSON_ROUNDS; round++) {
+        slots = larson_slots[(ctx->index + round) % larson_threads];
+        for (int i = 0; i < LARSON_OPS_PER_ROUND; i++) {
+            slot_t *slot = &slots[rng_next(ctx) % LARSON_SLOTS];
+            timed_free(ctx, slot->ptr, slot->size);
+            slot->size = size_larson(ctx);
+            slot->ptr = timed_malloc(ctx, slot->size);
+        }
+        pthread_barrier_wait(&larson_barrier);
+    }
+
+    for (int i = 0; i < LARSON_SLOTS; i++) timed_free(ctx, slots[i].ptr, slots[i].size);
+    return NULL;
+}
+
+static void run_larson(unsigned num_threads) {
+    pthread_t threads[MAX_THREADS];
+    larson_threads = num_threads;
+    pthread_barrier_init(&larson_barrier, NULL, num_threads);
+    for (unsigned i = 0; i < num_threads; i++) pthread_create(&threads[i], NULL, larson_worker, &contexts[i]);
+    for (unsigned i = 0; i < num_threads; i++) pthread_join(threads[i], NULL);
+
+    pthread_barrier_destroy(&larson_barrier);
+}
+
+/**
+ * Single producer, single consumer ring. The object's size travels in its first word
+ */
+typedef struct {
+    void *items[QUEUE_SIZE];
+    size_t head;  // Next item the consumer takes
+    char pad[64];  // Keeps the two ends on separate cache lines
+    size_t tail;  // Next slot the producer fills
+    char pad_tail[64];
+} queue_t;
+
+static queue_t queues[MAX_THREADS / 2];
+
+static void *producer(void *arg) {
+    thread_ctx_t *ctx = arg;
+    queue_t *queue = &queues[ctx->index / 2];
+
+    for (int i = 0; i < QUEUE_OBJECTS; i++) {
+        size_t size = size_larson(ctx);
+        void *ptr = timed_malloc(ctx, size);
+        *(size_t *)ptr = size;
+
+        size_t tail = queue->tail;
+        while (tail - __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE) == QUEUE_SIZE) sched_yield();
+        queue->items[tail % QUEUE_SIZE] = ptr;
+        __atomic_store_n(&queue->tail, tail + 1, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+static void *consumer(void *arg) {
+    thread_ctx_t *ctx = arg;
+    queue_t *queue = &queues[ctx->index / 2];
+
+    for (int i = 0; i < QUEUE_OBJECTS; i++) {
+        size_t head = queue->head;
+        while (__atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE) == head) sched_yield();
+        void *ptr = queue->items[head % QUEUE_SIZE];
+        __atomic_store_n(&queue->head, head + 1, __ATOMIC_RELEASE);
+
+        timed_free(ctx, ptr, *(size_t *)ptr);
+    }
+    return NULL;
+}
+
+/**
+ * Pairs of threads, one allocating and passing objects on, the other freeing them
+ */
+static void run_producer_consumer(unsigned num_threads) {
+    pthread_t threads[MAX_THREADS];
+    num_threads &= ~1u;
+
+    for (unsigned i = 0; i < num_threads; i++) {
+        pthread_create(&threads[i], NULL, i % 2 == 0 ? producer : consumer, &contexts[i]);
+    }
+    for (unsigned i = 0; i < num_threads; i++) pthread_join(threads[i], NULL);
+}
+
+static const workload_t workloads[] = {
+    {"fixed", run_fixed, false},
+    {"power_law", run_power_law, false},
+    {"bimodal", run_bimodal, false},
+    {"larson", run_larson, true},
+    {"producer_consumer", run_producer_consumer, true},
+};
+#define NUM_WORKLOADS (sizeof(workloads) / sizeof(workloads[0]))
+
+static long current_rss_kb() {
+    long pages = 0, resident = 0;
+    FILE *statm = fopen("/proc/self/statm", "r");
+    if (statm == NULL) return 0;
+    if (fscanf(statm, "%ld %ld", &pages, &resident) != 2) resident = 0;
+    fclose(statm);
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/**
+ * Runs one workload on one allocator, in the child process
+ */
+static void run_benchmark(const workload_t *workload, unsigned num_threads, bench_result_t *result) {
+    memset(contexts, 0, sizeof(contexts));
+    memset(churn_slots, 0, sizeof(churn_slots));
+    memset(larson_slots, 0, sizeof(larson_slots));
+    memset(queues, 0, sizeof(queues));
+    active_threads = workload->threaded ? num_threads : 1;
+    for (unsigned i = 0; i < active_threads; i++) {
+        contexts[i].rng = 0x9E3779B97F4A7C15ull * (i + 1);
+        contexts[i].index = i;
+    }
+    result->baseline_rss_kb = current_rss_kb();
+
+    if (allocator->strat >= 0) t_init((alloc_strat_e)allocator->strat);
+
+    double start = now_seconds();
+    workload->run(num_threads);
+    result->seconds = now_seconds() - start;
+
+    memset(&result->malloc_hist, 0, sizeof(histogram_t));
+    memset(&result->free_hist, 0, sizeof(histogram_t));
+    result->ops = 0;
+    for (unsigned i = 0; i < active_threads; i++) {
+        hist_merge(&result->malloc_hist, &contexts[i].malloc_hist);
+        hist_merge(&result->free_hist, &contexts[i].free_hist);
+        result->ops += contexts[i].ops;
+    }
+    result->peak_live = peak_live;
+}
+
+static void write_histogram(FILE *csv, const char *workload, const char *op, const histogram_t *hist) {
+    for (unsigned i = 0; i < HIST_BUCKETS; i++) {
+        if (hist->counts[i] == 0) continue;
+        fprintf(csv, "%s,%s,%s,%.1f,%llu\n", workload, allocator->name, op,
+                hist_bucket_max(i) * ns_per_cycle, (unsigned long long)hist->counts[i]);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    bool selected[NUM_ALLOCATORS];
+    for (size_t i = 0; i < NUM_ALLOCATORS; i++) selected[i] = argc == 1;
+    for (int arg = 1; arg < argc; arg++) {
+        size_t i = 0;
+        while (i < NUM_ALLOCATORS && strcmp(argv[arg], allocators[i].name) != 0) i++;
+        if (i == NUM_ALLOCATORS) {
+            fprintf(stderr, "Usage: %s [glibc|first_fit|best_fit|worst_fit|segregated_fit|tlsf ...]\n", argv[0]);
+            return 1;
+        }
+        selected[i] = true;
+    }
+    // Single strategy builds (TDMM_STRATEGY) refuse every strategy but the linked one
+    for (size_t i = 0; i < NUM_ALLOCATORS; i++) {
+        if (!selected[i] || allocators[i].strat < 0) continue;
+        tdmm_heap_t *probe = t_heap_create((alloc_strat_e)allocators[i].strat, NULL);
+        if (probe == NULL) {
+            printf("Skipping %s, it is not linked into this build\n", allocators[i].name);
+            selected[i] = false;
+            continue;
+        }
+        t_heap_destroy(probe);
+    }
+
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned num_threads = cores < 2 ? 2 : (cores > MAX_THREADS ? MAX_THREADS : (unsigned)cores);
+    calibrate_timer();
+
+    FILE *csv = fopen("bench.csv", "w");
+    FILE *hist_csv = fopen("bench_histogram.csv", "w");
+    if (!csv || !hist_csv) return 1;
+    fprintf(csv, "Workload,Allocator,Threads,Ops,Seconds,Ops_Per_Sec,"
+                 "Malloc_P50_Ns,Malloc_P99_Ns,Malloc_P999_Ns,Free_P50_Ns,Free_P99_Ns,Free_P999_Ns,"
+                 "Peak_RSS_KB,Peak_Requested_KB,Utilization\n");
+    fprintf(hist_csv, "Workload,Allocator,Op,Bucket_Max_Ns,Count\n");
+    printf("Cycle counter: %.3f ns per cycle, %llu cycles per reading subtracted\n",
+           ns_per_cycle, (unsigned long long)timer_overhead);
+
+    for (size_t w = 0; w < NUM_WORKLOADS; w++) {
+        const workload_t *workload = &workloads[w];
+        printf("\n--- Workload %s ---\n", workload->name);
+
+        for (size_t a = 0; a < NUM_ALLOCATORS; a++) {
+            if (!selected[a]) continue;
+            allocator = &allocators[a];
+#ifndef TDMM_THREAD_SAFE
+            // libtdmm takes no locks in this build
+            if (workload->threaded && allocator->strat >= 0) continue;
+#endif
+
+            // The child runs the workload, so its peak RSS is the run's alone
+            int fds[2];
+            if (pipe(fds) != 0) return 1;
+            fflush(stdout);
+            pid_t pid = fork();
+            if (pid < 0) return 1;
+            if (pid == 0) {
+                close(fds[0]);
+                static bench_result_t child_result;
+                run_benchmark(workload, num_threads, &child_result);
+                const char *data = (const char *)&child_result;
+                size_t left = sizeof(child_result);
+                while (left > 0) {
+                    ssize_t written = write(fds[1], data, left);
+                    if (written <= 0) _exit(1);
+                    data += written;
+                    left -= (size_t)written;
+                }
+                _exit(0);
+            }
+
+            close(fds[1]);
+            static bench_result_t result;
+            char *data = (char *)&result;
+            size_t got = 0;
+            while (got < sizeof(result)) {
+                ssize_t n = read(fds[0], data + got, sizeof(result) - got);
+                if (n <= 0) break;
+                got += (size_t)n;
+            }
+            close(fds[0]);
+
+            int status;
+            struct rusage usage;
+            wait4(pid, &status, 0, &usage);
+            if (got < sizeof(result) || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                fprintf(stderr, "Error: %s on %s did not finish\n", workload->name, allocator->name);
+                continue;
+            }
+
+            // RSS grown during the run, not counting what the process held before it started
+            long peak_rss_kb = usage.ru_maxrss - result.baseline_rss_kb;
+            if (peak_rss_kb < 1) peak_rss_kb = 1;
+            double utilization = (double)result.peak_live / (peak_rss_kb * 1024.0);
+            unsigned threads = workload->threaded ? num_threads : 1;
+
+            double malloc_p[3] = {hist_percentile(&result.malloc_hist, 0.5), hist_percentile(&result.malloc_hist, 0.99),
+                                  hist_percentile(&result.malloc_hist, 0.999)};
+            double free_p[3] = {hist_percentile(&result.free_hist, 0.5), hist_percentile(&result.free_hist, 0.99),
+                                hist_percentile(&result.free_hist, 0.999)};
+
+            printf("  %-15s %u thr %10.0f ops/s  malloc p50/p99/p99.9 %6.0f/%6.0f/%7.0f ns  "
+                   "free %6.0f/%6.0f/%7.0f ns  RSS %7ld KiB  util %5.1f%%\n",
+                   allocator->name, threads, result.ops / result.seconds,
+                   malloc_p[0], malloc_p[1], malloc_p[2], free_p[0], free_p[1], free_p[2],
+                   peak_rss_kb, utilization * 100);
+            fprintf(csv, "%s,%s,%u,%llu,%.6f,%.2f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%ld,%lld,%.4f\n",
+                    workload->name, allocator->name, threads, (unsigned long long)result.ops, result.seconds,
+                    result.ops / result.seconds, malloc_p[0], malloc_p[1], malloc_p[2], free_p[0], free_p[1], free_p[2],
+                    peak_rss_kb, result.peak_live / 1024, utilization);
+            write_histogram(hist_csv, workload->name, "malloc", &result.malloc_hist);
+            write_histogram(hist_csv, workload->name, "free", &result.free_hist);
+        }
+    }
+
+    fclose(csv);
+    fclose(hist_csv);
+    printf("\nResults saved to bench.csv, latency histograms to bench_histogram.csv\n");
+    return 0;
+}
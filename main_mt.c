@@ -0,0 +1,123 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "libtdmm/tdmm.h"
+#include <time.h>
+
+// Multi-threaded variant of the comparative benchmark in main.c: every thread runs the
+// same 70% malloc / 30% free loop on its own allocations, and the run is repeated for
+// 1..N threads to show how throughput scales with cores.
+
+#define OPS_PER_THREAD 10000
+
+typedef struct {
+    void* ptr;
+    size_t size;
+} alloc_record_t;
+
+typedef struct {
+    unsigned seed;
+    size_t max_alloc_size;
+} worker_args_t;
+
+typedef struct {
+    const char *name;
+    size_t max_alloc_size;
+} workload_t;
+
+static const workload_t workloads[] = {
+    {"mixed", 4096},  // Same size range as main.c
+    {"small", 256},   // Dominated by thread cache hits
+};
+
+static void *worker(void *arg) {
+    worker_args_t *args = (worker_args_t *)arg;
+    unsigned seed = args->seed;
+
+    alloc_record_t *records = malloc(sizeof(alloc_record_t) * OPS_PER_THREAD);
+    int active_allocs = 0;
+
+    for (int i = 0; i < OPS_PER_THREAD; i++) {
+        if (active_allocs == 0 || (rand_r(&seed) % 100 < 70)) {
+            size_t size = (rand_r(&seed) % args->max_alloc_size) + 1;
+            void *p = t_malloc(size);
+            if (p) {
+                // Touch the block so cache-line traffic between cores shows up
+                memset(p, 0xAB, size < 64 ? size : 64);
+                records[active_allocs].ptr = p;
+                records[active_allocs].size = size;
+                active_allocs++;
+            }
+        } else {
+            int index = rand_r(&seed) % active_allocs;
+            t_free(records[index].ptr);
+            records[index] = records[active_allocs - 1];
+            active_allocs--;
+        }
+    }
+
+    // Hand everything back so the next run starts from the same heap
+    for (int i = 0; i < active_allocs; i++) t_free(records[i].ptr);
+    free(records);
+    return NULL;
+}
+
+static double run_threads(int num_threads, size_t max_alloc_size) {
+    pthread_t threads[num_threads];
+    worker_args_t args[num_threads];
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (int t = 0; t < num_threads; t++) {
+        args[t].seed = 42 + t;
+        args[t].max_alloc_size = max_alloc_size;
+        pthread_create(&threads[t], NULL, worker, &args[t]);
+    }
+    for (int t = 0; t < num_threads; t++) pthread_join(threads[t], NULL);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    long long nsec = (end.tv_sec - start.tv_sec) * 1000000000LL + (end.tv_nsec - start.tv_nsec);
+    return (double)num_threads * OPS_PER_THREAD / (nsec / 1e9);
+}
+
+static void run_scaling_benchmark(alloc_strat_e strat, const char *name, int max_threads, FILE *csv_file) {
+    for (size_t w = 0; w < sizeof(workloads) / sizeof(workloads[0]); w++) {
+        if (t_init(strat) != 0) {
+            printf("\n--- %s is not linked into this build, skipped ---\n", name);
+            return;
+        }
+
+        printf("\n--- Scaling for %s (%s, 1-%zu bytes) ---\n", name, workloads[w].name, workloads[w].max_alloc_size);
+        double baseline = 0;
+        for (int threads = 1; threads <= max_threads; threads++) {
+            double ops_per_sec = run_threads(threads, workloads[w].max_alloc_size);
+            if (threads == 1) baseline = ops_per_sec;
+
+            printf("  %2d threads: %12.2f ops/sec  (%.2fx)\n", threads, ops_per_sec, ops_per_sec / baseline);
+            fprintf(csv_file, "%s,%s,%d,%.2f,%.3f\n", name, workloads[w].name, threads, ops_per_sec, ops_per_sec / baseline);
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int max_threads = argc > 1 ? atoi(argv[1]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (max_threads < 1) max_threads = 1;
+
+    FILE *csv = fopen("scaling.csv", "w");
+    if (!csv) return 1;
+    fprintf(csv, "Strategy,Workload,Threads,Throughput_Ops_Sec,Speedup\n");
+
+    run_scaling_benchmark(FIRST_FIT, "FIRST_FIT", max_threads, csv);
+    run_scaling_benchmark(BEST_FIT, "BEST_FIT", max_threads, csv);
+    run_scaling_benchmark(WORST_FIT, "WORST_FIT", max_threads, csv);
+    run_scaling_benchmark(SEGREGATED_FIT, "SEGREGATED_FIT", max_threads, csv);
+    run_scaling_benchmark(TLSF, "TLSF", max_threads, csv);
+
+    fclose(csv);
+    printf("\nScaling data saved to scaling.csv\n");
+    return 0;
+}
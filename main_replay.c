@@ -0,0 +1,329 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "libtdmm/tdmm.h"
+#include "trace.h"
+#include <time.h>
+
+// Replays a trace recorded with t_trace_start (a TDMM_TRACE build) against each strategy,
+// so strategies can be compared on a real program's allocations instead of main.c's
+// synthetic loop. Usage: hw6_replay trace.bin [strategy ...], all strategies by default.
+//
+// The trace is first translated into ops on numbered objects, then every strategy replays
+// them twice: once timed, once polling t_get_stats after every op for the memory figures.
+// Builds configured with TDMM_COUNTERS also report the timed pass's hot-path counters.
+// Events of several threads are replayed from one thread, in the order they were logged.
+// The counters therefore add up the whole trace, they can't be split by the logging thread.
+
+#define NO_OBJECT SIZE_MAX
+
+typedef struct {
+    trace_op_e op;
+    size_t object;      // Object allocated, or freed for TRACE_FREE
+    size_t old_object;  // Object a realloc resizes, NO_OBJECT for realloc(NULL, size)
+    size_t size;
+    size_t alignment;
+} replay_op_t;
+
+typedef struct {
+    replay_op_t *ops;
+    size_t num_ops;
+    size_t num_objects;
+} replay_t;
+
+typedef struct {
+    const char *name;
+    alloc_strat_e strat;
+} strategy_t;
+
+static const strategy_t strategies[] = {
+    {"first_fit", FIRST_FIT},
+    {"best_fit", BEST_FIT},
+    {"worst_fit", WORST_FIT},
+    {"segregated_fit", SEGREGATED_FIT},
+    {"tlsf", TLSF},
+};
+#define NUM_STRATEGIES (sizeof(strategies) / sizeof(strategies[0]))
+
+/**
+ * Live addresses of the traced program and the objects they hold. Open addressing
+ * with linear probing, deletions shift the rest of the cluster back
+ */
+typedef struct {
+    uint64_t *keys;  // 0 marks an empty slot, no block lives at address 0
+    size_t *objects;
+    size_t mask;
+} address_map_t;
+
+static size_t address_hash(const address_map_t *map, uint64_t key) {
+    return (size_t)((key >> 4) * 0x9E3779B97F4A7C15ull) & map->mask;
+}
+
+static void address_map_put(address_map_t *map, uint64_t key, size_t object) {
+    size_t i = address_hash(map, key);
+    while (map->keys[i] != 0 && map->keys[i] != key) i = (i + 1) & map->mask;
+    map->keys[i] = key;
+    map->objects[i] = object;
+}
+
+/**
+ * Removes key and returns its object, or NO_OBJECT if the address isn't live
+ */
+static size_t address_map_take(address_map_t *map, uint64_t key) {
+    size_t i = address_hash(map, key);
+    while (map->keys[i] != key) {
+        if (map->keys[i] == 0) return NO_OBJECT;
+        i = (i + 1) & map->mask;
+    }
+    size_t object = map->objects[i];
+
+    // Move later entries of the cluster into the hole if their probe passes it
+    size_t hole = i;
+    for (size_t j = (i + 1) & map->mask; map->keys[j] != 0; j = (j + 1) & map->mask) {
+        size_t home = address_hash(map, map->keys[j]);
+        if (((j - home) & map->mask) >= ((j - hole) & map->mask)) {
+            map->keys[hole] = map->keys[j];
+            map->objects[hole] = map->objects[j];
+            hole = j;
+        }
+    }
+    map->keys[hole] = 0;
+    return object;
+}
+
+/**
+ * Translates the events into ops on objects. Frees of addresses the trace never handed out
+ * (allocated before recording started) and failed allocations are dropped
+ */
+static int replay_build(replay_t *replay, const trace_event_t *events, size_t num_events) {
+    address_map_t map;
+    size_t capacity = 16;
+    while (capacity < 2 * num_events) capacity *= 2;
+    map.keys = calloc(capacity, sizeof(uint64_t));
+    map.objects = malloc(capacity * sizeof(size_t));
+    map.mask = capacity - 1;
+    replay->ops = malloc((num_events ? num_events : 1) * sizeof(replay_op_t));
+    if (map.keys == NULL || map.objects == NULL || replay->ops == NULL) return -1;
+
+    replay->num_ops = 0;
+    replay->num_objects = 0;
+    for (size_t i = 0; i < num_events; i++) {
+        const trace_event_t *event = &events[i];
+        replay_op_t op = {trace_event_op(event), NO_OBJECT, NO_OBJECT, trace_event_size(event), 0};
+
+        switch (op.op) {
+        case TRACE_MALLOC:
+        case TRACE_CALLOC:
+        case TRACE_ALIGNED:
+            if (event->ptr == 0) continue;
+            if (op.op == TRACE_ALIGNED) op.alignment = (size_t)event->arg;
+            op.object = replay->num_objects++;
+            address_map_put(&map, event->ptr, op.object);
+            break;
+        case TRACE_REALLOC:
+            // A failed realloc left its block alone
+            if (event->ptr == 0 && op.size > 0) continue;
+            if (event->arg != 0) op.old_object = address_map_take(&map, event->arg);
+            if (op.size == 0) {
+                if (op.old_object == NO_OBJECT) continue;
+                op.op = TRACE_FREE;
+                op.object = op.old_object;
+                break;
+            }
+            op.object = replay->num_objects++;
+            address_map_put(&map, event->ptr, op.object);
+            break;
+        case TRACE_FREE:
+            op.object = address_map_take(&map, event->ptr);
+            if (op.object == NO_OBJECT) continue;
+            break;
+        default:
+            fprintf(stderr, "Error: unknown event %d at index %zu\n", (int)op.op, i);
+            return -1;
+        }
+
+        replay->ops[replay->num_ops++] = op;
+    }
+
+    free(map.keys);
+    free(map.objects);
+    return 0;
+}
+
+/**
+ * Runs one op. objects holds the replay's own pointers, sizes (if not NULL) the bytes
+ * each live object was requested with. Returns the change in requested bytes
+ */
+static long long replay_op(const replay_op_t *op, void **objects, size_t *sizes) {
+    void *ptr;
+    switch (op->op) {
+    case TRACE_MALLOC:
+        ptr = t_malloc(op->size);
+        break;
+    case TRACE_CALLOC:
+        ptr = t_calloc(1, op->size);
+        break;
+    case TRACE_ALIGNED:
+        ptr = t_aligned_alloc(op->alignment, op->size);
+        break;
+    case TRACE_REALLOC: {
+        void *old = op->old_object == NO_OBJECT ? NULL : objects[op->old_object];
+        ptr = t_realloc(old, op->size);
+        if (ptr == NULL) break;
+        long long delta = (long long)op->size;
+        if (old != NULL) {
+            objects[op->old_object] = NULL;
+            if (sizes) delta -= (long long)sizes[op->old_object];
+        }
+        objects[op->object] = ptr;
+        if (sizes) sizes[op->object] = op->size;
+        return delta;
+    }
+    default:
+        ptr = objects[op->object];
+        t_free(ptr);
+        objects[op->object] = NULL;
+        return ptr != NULL && sizes ? -(long long)sizes[op->object] : 0;
+    }
+
+    objects[op->object] = ptr;
+    if (ptr == NULL) return 0;
+    if (sizes) sizes[op->object] = op->size;
+    return (long long)op->size;
+}
+
+static long long elapsed_ns(const struct timespec *start, const struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) * 1000000000LL + (end->tv_nsec - start->tv_nsec);
+}
+
+static void run_replay(const replay_t *replay, const strategy_t *strategy) {
+    void **objects = calloc(replay->num_objects ? replay->num_objects : 1, sizeof(void *));
+    size_t *sizes = calloc(replay->num_objects ? replay->num_objects : 1, sizeof(size_t));
+    if (objects == NULL || sizes == NULL) {
+        fprintf(stderr, "Error: out of memory for %zu objects\n", replay->num_objects);
+        exit(1);
+    }
+
+    // Timed pass, nothing but the allocator calls
+    if (t_init(strategy->strat) != 0) {
+        printf("\n--- %s is not linked into this build, skipped ---\n", strategy->name);
+        free(objects);
+        free(sizes);
+        return;
+    }
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < replay->num_ops; i++) replay_op(&replay->ops[i], objects, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    long long total_nsec = elapsed_ns(&start, &end);
+    // Only builds configured with TDMM_COUNTERS count the hot paths
+    tdmm_counters_t counters;
+    bool counted = t_get_counters(&counters) == 0;
+
+    // Same ops again on a fresh heap, sampling the stats after each one
+    memset(objects, 0, replay->num_objects * sizeof(void *));
+    t_init(strategy->strat);
+    size_t live = 0;
+    size_t peak_live = 0;
+    size_t peak_mapped = 0;
+    tdmm_stats_t stats;
+    for (size_t i = 0; i < replay->num_ops; i++) {
+        live += replay_op(&replay->ops[i], objects, sizes);
+        if (live > peak_live) peak_live = live;
+
+        t_get_stats(&stats);
+        if (stats.mapped_bytes > peak_mapped) peak_mapped = stats.mapped_bytes;
+    }
+
+    printf("\n--- Replay on %s ---\n", strategy->name);
+    printf("  Total Time: %lld ns\n", total_nsec);
+    printf("  Time per Op: %.1f ns\n", replay->num_ops ? (double)total_nsec / replay->num_ops : 0.0);
+    printf("  Peak Mapped: %zu bytes\n", peak_mapped);
+    printf("  Peak Requested: %zu bytes\n", peak_live);
+    // Share of the peak footprint that never held requested bytes
+    printf("  Fragmentation at Peak: %.2f%%\n", peak_mapped ? 100.0 * (1.0 - (double)peak_live / peak_mapped) : 0.0);
+    // How much of the free memory at the end can't serve one request of its total size
+    printf("  External Fragmentation at End: %.2f%%\n",
+           stats.free_bytes ? 100.0 * (1.0 - (double)stats.largest_free_block / stats.free_bytes) : 0.0);
+    if (counted) {
+        printf("  Searches: %zu, %.2f blocks looked at each, %.2f%% exact fits\n", counters.searches,
+               counters.searches ? (double)counters.search_steps / counters.searches : 0.0,
+               counters.searches ? 100.0 * counters.exact_fits / counters.searches : 0.0);
+        printf("  Splits: %zu\n", counters.splits);
+        printf("  Coalesces: %zu left, %zu right\n", counters.coalesce_left, counters.coalesce_right);
+        printf("  Heap Growth: %zu mappings, %zu bytes\n", counters.grows, counters.grow_bytes);
+    }
+
+    free(objects);
+    free(sizes);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s trace.bin [first_fit|best_fit|worst_fit|segregated_fit|tlsf ...]\n", argv[0]);
+        return 1;
+    }
+
+    for (int arg = 2; arg < argc; arg++) {
+        bool known = false;
+        for (size_t i = 0; i < NUM_STRATEGIES; i++) known |= strcmp(argv[arg], strategies[i].name) == 0;
+        if (!known) {
+            fprintf(stderr, "Error: unknown strategy %s\n", argv[arg]);
+            return 1;
+        }
+    }
+
+    int fd = open(argv[1], O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        perror(argv[1]);
+        return 1;
+    }
+    size_t length = (size_t)st.st_size;
+    if (length < sizeof(trace_header_t)) {
+        fprintf(stderr, "Error: %s is not a trace\n", argv[1]);
+        return 1;
+    }
+
+    const char *data = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+
+    const trace_header_t *header = (const trace_header_t *)data;
+    if (memcmp(header->magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0 ||
+        header->version != TRACE_VERSION || header->event_size != sizeof(trace_event_t)) {
+        fprintf(stderr, "Error: %s is not a version %d trace\n", argv[1], TRACE_VERSION);
+        return 1;
+    }
+
+    // A trace cut short by a crash ends in a partial event, which is ignored
+    const trace_event_t *events = (const trace_event_t *)(data + sizeof(trace_header_t));
+    size_t num_events = (length - sizeof(trace_header_t)) / sizeof(trace_event_t);
+
+    replay_t replay;
+    if (replay_build(&replay, events, num_events) != 0) return 1;
+    double duration = num_events ? events[num_events - 1].time_ns / 1e9 : 0.0;
+    printf("Trace %s: %zu events over %.3f s, %zu ops on %zu objects replayed\n",
+           argv[1], num_events, duration, replay.num_ops, replay.num_objects);
+    munmap((void *)data, length);
+
+    for (size_t i = 0; i < NUM_STRATEGIES; i++) {
+        bool selected = argc == 2;
+        for (int arg = 2; arg < argc; arg++) {
+            if (strcmp(argv[arg], strategies[i].name) == 0) selected = true;
+        }
+        if (selected) run_replay(&replay, &strategies[i]);
+    }
+
+    free(replay.ops);
+    return 0;
+}
@@ -0,0 +1,449 @@
+/**
+ * The engine shared by every strategy: splitting, coalescing, growing the heap, resizing,
+ * batches and stats. Strategies differ only in how they keep their free blocks, and each
+ * is instantiated by a source file that defines
+ *
+ *   FIT_PREFIX                          the strategy's name, e.g. first_fit
+ *   FIT_HEAP                            its heap type, with the regions, currently_allocated,
+ *                                       num_allocated, free_stats and counters members
+ *
+ * and the static functions
+ *
+ *   free_lists_init(heap)               empties the free lists
+ *   free_lists_insert(heap, block)      puts a free block on the lists
+ *   free_lists_remove(heap, block)      takes it off again
+ *   free_lists_replace(heap, old, block)  puts block where old was, block is old's tail
+ *   find_fit(heap, size)                returns a free block of at least size bytes, or NULL
+ *   find_largest_free(heap)             returns the size of the largest free block
+ *
+ * and then includes this file, which defines the strategy's prefix_* functions and
+ * its prefix_ops table. The hooks are inlined into them
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "region.h"
+#include "strategy.h"
+
+#define FIT(name) FIT_NAME(FIT_PREFIX, name)
+#define FIT_NAME(prefix, name) FIT_NAME_(prefix, name)
+#define FIT_NAME_(prefix, name) prefix##_##name
+
+/**
+ * Makes a block available for allocation, keeping the free stats in step
+ */
+static void free_insert(FIT_HEAP *heap, block_header_t *block) {
+    free_lists_insert(heap, block);
+    free_stats_add(&heap->free_stats, block_size(block));
+}
+
+static void free_remove(FIT_HEAP *heap, block_header_t *block) {
+    region_forget_free(&heap->regions, block);
+    free_lists_remove(heap, block);
+    free_stats_remove(&heap->free_stats, block_size(block));
+}
+
+/**
+ * Merges a free block with its free physical neighbours, taking them off the free lists.
+ * Returns the merged block, which is not on any list
+ */
+static block_header_t *coalesce(FIT_HEAP *heap, block_header_t *block) {
+    // Read atomically, an allocated neighbour's owner may be updating its tags, see block_set_atomic
+    block_header_t *next = block_next(block);
+    if (block_flags(next) & BLOCK_FREE) {
+        free_remove(heap, next);
+        block_absorb(block, next);
+        COUNTER_ADD(heap, coalesce_right, 1);
+    }
+
+    if (block_prev_is_free(block)) {
+        block_header_t *prev = block_prev(block);
+        free_remove(heap, prev);
+        block_absorb(prev, block);
+        block = prev;
+        COUNTER_ADD(heap, coalesce_left, 1);
+    }
+
+    return block;
+}
+
+/**
+ * Writes the boundary tags of a coalesced free block and makes it available again
+ */
+static void free_block_insert(FIT_HEAP *heap, block_header_t *block) {
+    block_write_footer(block);
+    // The neighbour may be an allocated block its owner is freeing right now
+    block_set_atomic(block_next(block), BLOCK_PREV_FREE, true);
+    free_insert(heap, block);
+    region_note_free(&heap->regions, block);
+}
+
+/**
+ * Requests memory via mmap and adds it to the free lists
+ */
+static block_header_t *request_more_memory(FIT_HEAP *heap, size_t required_size) {
+    // Allocation-heavy phases rarely free, catch up on decay when the heap grows too
+    region_decay(&heap->regions);
+
+    // Room for the epilogue and region trailer as well
+    size_t mapped_before = heap->regions.total_mapped;
+    block_header_t *new_block = region_map(&heap->regions, required_size + REGION_OVERHEAD);
+    if (new_block == NULL) return NULL;
+    COUNTER_ADD(heap, grows, 1);
+    COUNTER_ADD(heap, grow_bytes, heap->regions.total_mapped - mapped_before);
+
+    // The pages may have extended a region, merge with the free blocks at the seam
+    new_block = coalesce(heap, new_block);
+    free_block_insert(heap, new_block);
+
+    return new_block;
+}
+
+/**
+ * Gives the tail of an allocated block past size back as a free block, if it is large enough to be one
+ */
+static void shrink_block(FIT_HEAP *heap, block_header_t *block, size_t size) {
+    if (block_size(block) < size + HEADER_SIZE + MIN_PAYLOAD) return;
+
+    block_header_t *rest = (block_header_t *)((char *)block + HEADER_SIZE + size);
+    rest->size_flags = (block_size(block) - size - HEADER_SIZE) | BLOCK_FREE;
+    block_set_size(block, size);
+    STAT_SUB(heap->currently_allocated, block_size(rest) + HEADER_SIZE);
+    COUNTER_ADD(heap, splits, 1);
+
+    rest = coalesce(heap, rest);
+    free_block_insert(heap, rest);
+}
+
+/**
+ * Returns a block the caller has taken out of the stats to the free lists, or to the OS
+ */
+static void release_block(FIT_HEAP *heap, block_header_t *block) {
+    block_set(block, BLOCK_FREE, true);
+    block_set(block, BLOCK_PURGED | BLOCK_ZEROED, false);
+    block = coalesce(heap, block);
+
+    // Hand the region back to the OS once nothing in it is allocated
+    if (region_try_release(&heap->regions, block)) return;
+
+    free_block_insert(heap, block);
+}
+
+int FIT(init)(FIT_HEAP *heap, const region_config_t *config) {
+    region_list_init(&heap->regions, config);
+    heap->currently_allocated = 0;
+    heap->num_allocated = 0;
+    free_lists_init(heap);
+    free_stats_init(&heap->free_stats);
+#ifdef TDMM_COUNTERS
+    memset(&heap->counters, 0, sizeof(heap->counters));
+#endif
+
+    block_header_t *first_block = region_map(&heap->regions, config->initial_size);
+    if (first_block == NULL) {
+        fprintf(stderr, "Error: MMAP failed\n");
+        // Gives back the reserved range, a failed init holds no memory
+        region_list_destroy(&heap->regions);
+        return -1;
+    }
+
+    free_block_insert(heap, first_block);
+
+    return 0;
+}
+
+void *FIT(malloc)(FIT_HEAP *heap, size_t size) {
+    if (size <= 0) return NULL;
+
+    size_t aligned_size = block_payload_size(size);
+    if (aligned_size == 0) return NULL;
+    size_t total_required = aligned_size + HEADER_SIZE;
+    block_header_t *curr = find_fit(heap, aligned_size);
+    COUNTER_ADD(heap, searches, 1);
+    if (curr != NULL && block_size(curr) == aligned_size) COUNTER_ADD(heap, exact_fits, 1);
+
+    // If no fit, out of memory and attempt to acquire more memory
+    if (curr == NULL) {
+        curr = request_more_memory(heap, total_required);
+        // Actually out of memory
+        if (curr == NULL) return NULL;
+    }
+
+    // Only split if remainder can hold a header + the smallest payload
+    if (block_size(curr) >= (aligned_size + HEADER_SIZE + MIN_PAYLOAD)) {
+        block_header_t *new_block = (block_header_t *)((char *)curr + HEADER_SIZE + aligned_size);
+        // The remainder's header may land on curr's dirty links, unlink curr first
+        region_forget_free(&heap->regions, curr);
+        // The remainder keeps curr's purge and zero state, its left neighbour is now allocated
+        new_block->size_flags = (block_size(curr) - aligned_size - HEADER_SIZE) | BLOCK_FREE |
+                                (curr->size_flags & (BLOCK_PURGED | BLOCK_ZEROED));
+        block_set_epoch(new_block, block_epoch(curr));
+        block_write_footer(new_block);
+
+        free_lists_replace(heap, curr, new_block);
+        free_stats_split(&heap->free_stats, block_size(curr), block_size(new_block));
+        region_note_split(&heap->regions, new_block);
+
+        block_set_size(curr, aligned_size);
+        COUNTER_ADD(heap, splits, 1);
+    }
+    else {
+        // Not splitting, just remove curr from the free lists entirely
+        free_remove(heap, curr);
+        block_set_atomic(block_next(curr), BLOCK_PREV_FREE, false);
+    }
+
+    block_set(curr, BLOCK_FREE, false);
+
+    // Update stats
+    STAT_ADD(heap->currently_allocated, block_size(curr) + HEADER_SIZE);
+    STAT_ADD(heap->num_allocated, 1);
+
+    // Return pointer
+    return (void *)((char *)curr + HEADER_SIZE);
+}
+
+/**
+ * Allocates a block whose payload is aligned to alignment, a power of two. The block is
+ * over-allocated, then the gap in front of the boundary and the unused tail are freed again
+ */
+void *FIT(memalign)(FIT_HEAP *heap, size_t alignment, size_t size) {
+    if (alignment <= BLOCK_ALIGN) return FIT(malloc)(heap, size);
+
+    size_t aligned_size = block_payload_size(size);
+    if (size == 0 || aligned_size == 0) return NULL;
+
+    // Any gap in front of the boundary must be able to stand as a free block of its own
+    char *ptr = FIT(malloc)(heap, aligned_size + alignment + MIN_BLOCK_SIZE);
+    if (ptr == NULL) return NULL;
+
+    block_header_t *block = (block_header_t *)(ptr - HEADER_SIZE);
+    char *aligned = (char *)(((uintptr_t)ptr + alignment - 1) & ~(uintptr_t)(alignment - 1));
+    if (aligned != ptr) {
+        while ((size_t)(aligned - ptr) < MIN_BLOCK_SIZE) aligned += alignment;
+        size_t gap = (size_t)(aligned - ptr);
+
+        // The aligned block is marked allocated, its left neighbour is freed below
+        block_header_t *aligned_block = (block_header_t *)(aligned - HEADER_SIZE);
+        aligned_block->size_flags = block_size(block) - gap;
+
+        block_set_size(block, gap - HEADER_SIZE);
+        block_set(block, BLOCK_FREE, true);
+        block_set(block, BLOCK_PURGED | BLOCK_ZEROED, false);
+        STAT_SUB(heap->currently_allocated, gap);
+        free_block_insert(heap, coalesce(heap, block));
+
+        block = aligned_block;
+    }
+
+    shrink_block(heap, block, aligned_size);
+    return aligned;
+}
+
+/**
+ * Resizes an allocated block in place. It shrinks by splitting off its tail and grows into
+ * its free physical neighbours, moving the payload down only if the right one isn't enough.
+ * Returns the payload, or NULL if the block can't grow in place and was left untouched
+ */
+void *FIT(resize)(FIT_HEAP *heap, void *ptr, size_t size) {
+    size_t aligned_size = block_payload_size(size);
+    if (size == 0 || aligned_size == 0) return NULL;
+
+    block_header_t *block = (block_header_t *)((char *)ptr - HEADER_SIZE);
+    size_t old_size = block_size(block);
+
+    if (aligned_size > old_size) {
+        block_header_t *next = block_next(block);
+        size_t next_size = block_is_free(next) ? block_size(next) + HEADER_SIZE : 0;
+        block_header_t *prev = NULL;
+        size_t prev_size = 0;
+        if (old_size + next_size < aligned_size && block_prev_is_free(block)) {
+            prev = block_prev(block);
+            prev_size = block_size(prev) + HEADER_SIZE;
+        }
+        if (old_size + next_size + prev_size < aligned_size) return NULL;
+
+        if (next_size > 0) free_remove(heap, next);
+        if (prev != NULL) {
+            // Unlink before the payload moves over the left neighbour's links
+            free_remove(heap, prev);
+            block_set(prev, BLOCK_FREE | BLOCK_ZEROED, false);
+            memmove((char *)prev + HEADER_SIZE, ptr, old_size);
+            block = prev;
+        }
+
+        block_set_size(block, old_size + next_size + prev_size);
+        block_set_atomic(block_next(block), BLOCK_PREV_FREE, false);
+        STAT_ADD(heap->currently_allocated, next_size + prev_size);
+    }
+
+    shrink_block(heap, block, aligned_size);
+    return (char *)block + HEADER_SIZE;
+}
+
+void FIT(free)(FIT_HEAP *heap, void *ptr) {
+    if (ptr == NULL) return;
+
+    block_header_t *header = (block_header_t *)((char *)ptr - HEADER_SIZE);
+
+    // Update stats
+    STAT_SUB(heap->currently_allocated, block_size(header) + HEADER_SIZE);
+    STAT_SUB(heap->num_allocated, 1);
+
+    release_block(heap, header);
+}
+
+/**
+ * Allocates count blocks of size bytes, carved front to back from one span that is
+ * found with a single search. Returns how many were allocated, fewer only if memory runs out
+ */
+size_t FIT(malloc_batch)(FIT_HEAP *heap, size_t size, size_t count, void **out) {
+    size_t aligned_size = block_payload_size(size);
+    if (size == 0 || aligned_size == 0) return 0;
+    size_t footprint = aligned_size + HEADER_SIZE;
+
+    size_t done = 0;
+    while (done < count) {
+        size_t batch = count - done;
+        if (batch > BLOCK_SIZE_MASK / footprint) batch = BLOCK_SIZE_MASK / footprint;
+
+        char *span = FIT(malloc)(heap, batch * footprint - HEADER_SIZE);
+        if (span == NULL) {
+            // No room for the whole batch, the rest come one block at a time instead of
+            // searching for a span that failed once already
+            while (done < count && (out[done] = FIT(malloc)(heap, size)) != NULL) done++;
+            break;
+        }
+
+        // The span is one allocated block, split it into batch blocks with the last taking any slack
+        block_header_t *block = (block_header_t *)(span - HEADER_SIZE);
+        size_t span_size = block_size(block);
+        for (size_t i = 0; i < batch - 1; i++) {
+            block_set_size(block, aligned_size);
+            out[done++] = (char *)block + HEADER_SIZE;
+            span_size -= footprint;
+
+            block = block_next(block);
+            block->size_flags = span_size;
+        }
+        out[done++] = (char *)block + HEADER_SIZE;
+        STAT_ADD(heap->num_allocated, batch - 1);
+    }
+
+    return done;
+}
+
+/**
+ * Frees count blocks, sorted by ascending address. Runs of physically adjacent blocks are
+ * merged first and enter the free lists as one block, so each run costs a single coalesce
+ */
+void FIT(free_batch)(FIT_HEAP *heap, void **ptrs, size_t count) {
+    size_t i = 0;
+    while (i < count) {
+        block_header_t *run = (block_header_t *)((char *)ptrs[i] - HEADER_SIZE);
+        STAT_SUB(heap->currently_allocated, block_size(run) + HEADER_SIZE);
+        STAT_SUB(heap->num_allocated, 1);
+
+        while (++i < count && (block_header_t *)((char *)ptrs[i] - HEADER_SIZE) == block_next(run)) {
+            block_header_t *next = block_next(run);
+            STAT_SUB(heap->currently_allocated, block_size(next) + HEADER_SIZE);
+            STAT_SUB(heap->num_allocated, 1);
+            block_set_size(run, block_size(run) + HEADER_SIZE + block_size(next));
+        }
+
+        release_block(heap, run);
+    }
+}
+
+/**
+ * Purges the pages of every large free block now instead of waiting for the decay timer
+ */
+void FIT(purge)(FIT_HEAP *heap) {
+    region_purge_all(&heap->regions);
+}
+
+/**
+ * Unmaps every region of the heap, allocated blocks included. The heap must be initialized again before reuse
+ */
+void FIT(destroy)(FIT_HEAP *heap) {
+    region_list_destroy(&heap->regions);
+}
+
+/**
+ * Returns the total bytes requested by OS
+ */
+size_t FIT(get_total_mapped_memory)(FIT_HEAP *heap) {
+    return STAT_LOAD(heap->regions.total_mapped);
+}
+
+/**
+ * Returns the total bytes handed back to the OS
+ */
+size_t FIT(get_total_released_memory)(FIT_HEAP *heap) {
+    return STAT_LOAD(heap->regions.total_released);
+}
+
+/**
+ * Returns the total bytes currently requested by the user
+ */
+size_t FIT(get_currently_allocated_memory)(FIT_HEAP *heap) {
+    return STAT_LOAD(heap->currently_allocated);
+}
+
+/**
+ * Calculates the total overhead of all headers, including region epilogues and trailers
+ */
+size_t FIT(get_structural_overhead)(FIT_HEAP *heap) {
+    size_t overhead = STAT_LOAD(heap->regions.num_regions) * REGION_OVERHEAD;
+    overhead += (STAT_LOAD(heap->num_allocated) + STAT_LOAD(heap->free_stats.num_free)) * HEADER_SIZE;
+    return overhead;
+}
+
+/**
+ * Fills in the block counts from the running totals, looking up the largest free block
+ * again only if it was allocated whole since the last call
+ */
+void FIT(get_stats)(FIT_HEAP *heap, strategy_stats_t *stats) {
+    free_stats_t *free_stats = &heap->free_stats;
+    if (free_stats->largest_stale) {
+        STAT_SET(free_stats->largest_free, find_largest_free(heap));
+        STAT_SET(free_stats->largest_stale, false);
+    }
+
+    stats->num_allocated = heap->num_allocated;
+    stats->num_free = free_stats->num_free;
+    stats->free_bytes = free_stats->free_bytes;
+    stats->largest_free = free_stats->largest_free;
+    memcpy(stats->free_histogram, free_stats->histogram, sizeof(stats->free_histogram));
+#ifdef TDMM_COUNTERS
+    stats->counters = heap->counters;
+#endif
+}
+
+/**
+ * Reads the block counts without the arena's lock, the fields may come from different
+ * moments. Returns false, filling in nothing, if the largest free block has to be looked
+ * up again, which needs get_stats under the lock
+ */
+bool FIT(peek_stats)(FIT_HEAP *heap, strategy_stats_t *stats) {
+    free_stats_t *free_stats = &heap->free_stats;
+    if (STAT_LOAD(free_stats->largest_stale)) return false;
+
+    stats->num_allocated = STAT_LOAD(heap->num_allocated);
+    stats->num_free = STAT_LOAD(free_stats->num_free);
+    stats->free_bytes = STAT_LOAD(free_stats->free_bytes);
+    stats->largest_free = STAT_LOAD(free_stats->largest_free);
+    return true;
+}
+
+/**
+ * Returns the regions, for walking the heap's blocks in place
+ */
+region_list_t *FIT(get_regions)(FIT_HEAP *heap) {
+    return &heap->regions;
+}
+
+STRATEGY_DEFINE_OPS(FIT_PREFIX);
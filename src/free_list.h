@@ -0,0 +1,52 @@
+/**
+ * Free list hooks of fit_engine.h for the strategies that keep all free blocks on one
+ * list: first, best and worst fit. Each strategy's source file includes this, defines
+ * its find_fit policy and then includes the engine
+ */
+#include <stddef.h>
+
+#include "list_fit.h"
+
+static void free_lists_init(list_fit_heap_t *heap) {
+    heap->free_list_head = NULL;
+}
+
+/**
+ * Pushes a block on the front of the free list. Neighbours are found through
+ * boundary tags, so the list no longer has to be kept in address order
+ */
+static void free_lists_insert(list_fit_heap_t *heap, block_header_t *block) {
+    block->prev_free = NULL;
+    block->next_free = heap->free_list_head;
+    if (heap->free_list_head) heap->free_list_head->prev_free = block;
+    heap->free_list_head = block;
+}
+
+static void free_lists_remove(list_fit_heap_t *heap, block_header_t *block) {
+    if (block->prev_free) block->prev_free->next_free = block->next_free;
+    if (block->next_free) block->next_free->prev_free = block->prev_free;
+    if (block == heap->free_list_head) heap->free_list_head = block->next_free;
+}
+
+/**
+ * Links the tail split off a free block into the list where the block used to be
+ */
+static void free_lists_replace(list_fit_heap_t *heap, block_header_t *old, block_header_t *block) {
+    block->next_free = old->next_free;
+    block->prev_free = old->prev_free;
+
+    if (block->prev_free) block->prev_free->next_free = block;
+    if (block->next_free) block->next_free->prev_free = block;
+    if (old == heap->free_list_head) heap->free_list_head = block;
+}
+
+/**
+ * Walks the whole list, the blocks are in no particular order
+ */
+static size_t find_largest_free(list_fit_heap_t *heap) {
+    size_t largest = 0;
+    for (block_header_t *curr = heap->free_list_head; curr != NULL; curr = curr->next_free) {
+        if (block_size(curr) > largest) largest = block_size(curr);
+    }
+    return largest;
+}
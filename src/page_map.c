@@ -0,0 +1,122 @@
+#include <sys/mman.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "block.h"
+#include "page_map.h"
+
+#ifdef TDMM_HARDENED
+#define PAGE_SIZE 4096
+#define PAGE_SHIFT 12
+
+#define LEAF_SHIFT 30
+#define LEAF_COUNT ((size_t)1 << (PAGE_MAP_ADDRESS_BITS - LEAF_SHIFT))
+#define LEAF_MASK (((uintptr_t)1 << LEAF_SHIFT) - 1)
+#define LEAF_WORDS (((size_t)1 << (LEAF_SHIFT - PAGE_SHIFT)) / 64)
+// One bit per BLOCK_ALIGN granule, 8 MiB of address space per GiB at the default alignment
+#define LIVE_LEAF_WORDS (((size_t)1 << LEAF_SHIFT) / BLOCK_ALIGN / 64)
+
+// Untouched entries stay in zero pages, so the tables cost little beyond their address space
+static uint64_t *leaves[LEAF_COUNT];
+static uint64_t *live_leaves[LEAF_COUNT];
+
+/**
+ * Returns the bitmap of words words covering addr in a table, mapping it first if create
+ * is set. Racing threads may both map one, the loser unmaps its copy
+ */
+static uint64_t *leaf_of(uint64_t **table, size_t words, uintptr_t addr, bool create) {
+    uint64_t **slot = &table[addr >> LEAF_SHIFT];
+    uint64_t *leaf = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+    if (leaf != NULL || !create) return leaf;
+
+    void *mapped = mmap(NULL, words * sizeof(uint64_t), PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (mapped == MAP_FAILED) return NULL;
+
+    if (!__atomic_compare_exchange_n(slot, &leaf, (uint64_t *)mapped, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        munmap(mapped, words * sizeof(uint64_t));
+        return leaf;
+    }
+    return mapped;
+}
+
+/**
+ * Clears the live bits of every granule in [addr, end), which lie in one leaf
+ */
+static void live_clear(uintptr_t addr, uintptr_t end) {
+    uint64_t *leaf = leaf_of(live_leaves, LIVE_LEAF_WORDS, addr, false);
+    if (leaf == NULL) return;
+
+    size_t first = (addr & LEAF_MASK) / BLOCK_ALIGN;
+    size_t last = first + (end - addr) / BLOCK_ALIGN;
+    while (first < last) {
+        size_t bit = first % 64;
+        size_t count = last - first < 64 - bit ? last - first : 64 - bit;
+        uint64_t mask = (count == 64 ? ~(uint64_t)0 : ((uint64_t)1 << count) - 1) << bit;
+        __atomic_fetch_and(&leaf[first / 64], ~mask, __ATOMIC_RELEASE);
+        first += count;
+    }
+}
+
+void page_map_set(void *start, size_t length, bool mapped) {
+    uintptr_t addr = (uintptr_t)start;
+    uintptr_t end = addr + length;
+    if (end >> PAGE_MAP_ADDRESS_BITS) return;
+
+    for (uintptr_t page = addr; page < end; page += PAGE_SIZE) {
+        uint64_t *leaf = leaf_of(leaves, LEAF_WORDS, page, mapped);
+        if (leaf == NULL) continue;
+
+        size_t index = (page & LEAF_MASK) >> PAGE_SHIFT;
+        uint64_t bit = (uint64_t)1 << (index % 64);
+        if (mapped) __atomic_fetch_or(&leaf[index / 64], bit, __ATOMIC_RELEASE);
+        else __atomic_fetch_and(&leaf[index / 64], ~bit, __ATOMIC_RELEASE);
+    }
+
+    // Blocks never freed die with their pages, a later mapping at the same address starts clean
+    if (mapped) return;
+    while (addr < end) {
+        uintptr_t leaf_end = (addr | LEAF_MASK) + 1;
+        if (leaf_end > end) leaf_end = end;
+        live_clear(addr, leaf_end);
+        addr = leaf_end;
+    }
+}
+
+bool page_map_contains(const void *ptr) {
+    uintptr_t addr = (uintptr_t)ptr;
+    if (addr >> PAGE_MAP_ADDRESS_BITS) return false;
+
+    uint64_t *leaf = leaf_of(leaves, LEAF_WORDS, addr, false);
+    if (leaf == NULL) return false;
+
+    size_t page = (addr & LEAF_MASK) >> PAGE_SHIFT;
+    return (__atomic_load_n(&leaf[page / 64], __ATOMIC_ACQUIRE) >> (page % 64)) & 1;
+}
+
+void page_map_set_live(const void *payload, bool live) {
+    uintptr_t addr = (uintptr_t)payload;
+    if (addr >> PAGE_MAP_ADDRESS_BITS) return;
+
+    uint64_t *leaf = leaf_of(live_leaves, LIVE_LEAF_WORDS, addr, live);
+    if (leaf == NULL) return;
+
+    size_t granule = (addr & LEAF_MASK) / BLOCK_ALIGN;
+    uint64_t bit = (uint64_t)1 << (granule % 64);
+    if (live) __atomic_fetch_or(&leaf[granule / 64], bit, __ATOMIC_RELEASE);
+    else __atomic_fetch_and(&leaf[granule / 64], ~bit, __ATOMIC_RELEASE);
+}
+
+bool page_map_claim(const void *payload) {
+    uintptr_t addr = (uintptr_t)payload;
+    if (addr >> PAGE_MAP_ADDRESS_BITS) return false;
+
+    uint64_t *leaf = leaf_of(live_leaves, LIVE_LEAF_WORDS, addr, false);
+    if (leaf == NULL) return false;
+
+    size_t granule = (addr & LEAF_MASK) / BLOCK_ALIGN;
+    uint64_t bit = (uint64_t)1 << (granule % 64);
+    return (__atomic_fetch_and(&leaf[granule / 64], ~bit, __ATOMIC_ACQ_REL) & bit) != 0;
+}
+
+#endif
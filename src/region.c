@@ -0,0 +1,334 @@
+#include <sys/mman.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "region.h"
+#include "page_map.h"
+#define PAGE_SIZE 4096
+// Frees between two reads of the clock while blocks wait on the dirty list
+#define DECAY_CHECK_OPS 64
+
+static unsigned long long now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void region_list_init(region_list_t *list, const region_config_t *config) {
+    list->head = NULL;
+    list->config = *config;
+    // A smaller block has no whole page to purge, and no room for its dirty links
+    if (config->purge_threshold != 0 && config->purge_threshold < PAGE_SIZE) list->config.purge_threshold = PAGE_SIZE;
+    list->next_chunk = config->min_chunk;
+    list->num_regions = 0;
+    list->total_mapped = 0;
+    list->total_released = 0;
+    list->total_purged = 0;
+    list->dirty_head = NULL;
+    list->decay_ops = 0;
+    list->purge_epoch = 0;
+    list->next_purge_ms = config->purge_threshold ? now_ms() + config->decay_ms : 0;
+
+    // Address space only, pages are committed front to back as the heap grows
+    list->reserve_next = NULL;
+    list->reserve_end = NULL;
+    if (config->reserve_bytes > 0) {
+        size_t length = (config->reserve_bytes + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+        void *reserved = mmap(NULL, length, PROT_NONE, MAP_ANONYMOUS | MAP_PRIVATE | MAP_NORESERVE, -1, 0);
+        if (reserved != MAP_FAILED) {
+            list->reserve_next = reserved;
+            list->reserve_end = (char *)reserved + length;
+        }
+    }
+}
+
+/**
+ * Gets length bytes of fresh pages, committed from the reserved range while it lasts
+ */
+static char *map_pages(region_list_t *list, size_t length) {
+    char *pages = NULL;
+    if (list->reserve_next != NULL && (size_t)(list->reserve_end - list->reserve_next) >= length &&
+        mprotect(list->reserve_next, length, PROT_READ | PROT_WRITE) == 0) {
+        pages = list->reserve_next;
+        list->reserve_next += length;
+    }
+    else {
+        void *mapped = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+        if (mapped == MAP_FAILED) return NULL;
+        pages = mapped;
+    }
+
+#ifdef TDMM_HARDENED
+    page_map_set(pages, length, true);
+#endif
+    return pages;
+}
+
+/**
+ * Unmaps length bytes of a region's pages
+ */
+static int unmap_pages(void *pages, size_t length) {
+    if (munmap(pages, length) != 0) return -1;
+
+#ifdef TDMM_HARDENED
+    page_map_set(pages, length, false);
+#endif
+    return 0;
+}
+
+/**
+ * Grows a region by pages mapped right below it. They become one free block in
+ * front of the region's first block, taking over the old pad
+ */
+static block_header_t *region_extend_down(region_t *region, char *pages, size_t length) {
+    block_header_t *block = (block_header_t *)(pages + BLOCK_PAD);
+    block->size_flags = (length - HEADER_SIZE) | BLOCK_FREE | BLOCK_PURGED | BLOCK_ZEROED;
+    block->next_free = NULL;
+    block->prev_free = NULL;
+    block_write_footer(block);
+
+    region->base = pages;
+    region->length += length;
+
+    return block;
+}
+
+/**
+ * Grows a region by pages mapped right above it. The old epilogue and trailer are
+ * absorbed into a free block running up to a new epilogue and trailer at the new end
+ */
+static block_header_t *region_extend_up(region_list_t *list, region_t *region, char *pages, size_t length) {
+    region_t old = *region;
+    block_header_t *epilogue = (block_header_t *)((char *)region - HEADER_SIZE);
+    // The old trailer becomes payload, clear it so the block counts as zeroed
+    memset(region, 0, REGION_TRAILER_SIZE);
+    bool prev_is_free = block_prev_is_free(epilogue);
+
+    block_header_t *block = block_format_region(epilogue, (size_t)(pages + length - REGION_TRAILER_SIZE - (char *)epilogue));
+    block_set(block, BLOCK_PREV_FREE, prev_is_free);
+
+    region_t *moved = region_of_epilogue(block_next(block));
+    *moved = old;
+    moved->length += length;
+    if (moved->prev) moved->prev->next = moved;
+    else list->head = moved;
+    if (moved->next) moved->next->prev = moved;
+
+    return block;
+}
+
+/**
+ * Joins two regions through pages that exactly fill the gap between them. The lower
+ * region's epilogue and trailer, the pages and the upper region's pad become one free
+ * block running up to the upper region's first block, which keeps its trailer
+ */
+static block_header_t *region_join(region_list_t *list, region_t *lower, char *pages, size_t length, region_t *upper) {
+    region_t old = *lower;
+    block_header_t *epilogue = (block_header_t *)((char *)lower - HEADER_SIZE);
+    memset(lower, 0, REGION_TRAILER_SIZE);
+    bool prev_is_free = block_prev_is_free(epilogue);
+
+    block_header_t *block = epilogue;
+    block->size_flags = ((char *)region_first_block(upper) - (char *)block - HEADER_SIZE) | BLOCK_FREE | BLOCK_PURGED | BLOCK_ZEROED;
+    block_set(block, BLOCK_PREV_FREE, prev_is_free);
+    block->next_free = NULL;
+    block->prev_free = NULL;
+    block_write_footer(block);
+
+    upper->base = old.base;
+    upper->length += old.length + length;
+    upper->prev = old.prev;
+    if (old.prev) old.prev->next = upper;
+    else list->head = upper;
+    STAT_SUB(list->num_regions, 1);
+
+    return block;
+}
+
+block_header_t *region_map(region_list_t *list, size_t min_length) {
+    // Map at least the next chunk so syscalls are amortized as the heap grows
+    size_t length = min_length > list->next_chunk ? min_length : list->next_chunk;
+    // We must request memory in multiples of the page size
+    length = (length + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+
+    char *pages = map_pages(list, length);
+    if (pages == NULL) return NULL;
+
+    STAT_ADD(list->total_mapped, length);
+    if (list->next_chunk < list->config.max_chunk) {
+        list->next_chunk *= 2;
+        if (list->next_chunk > list->config.max_chunk) list->next_chunk = list->config.max_chunk;
+    }
+
+    // Mappings usually land next to the previous one, top-down for mmap and
+    // bottom-up in the reserved range, so try to continue the regions around them.
+    // A region is only unmapped once all of it is free, so merging stops at max_chunk
+    // and a heap that shrinks after a peak can still hand its regions back one by one
+    region_t *prev = NULL;
+    region_t *next = list->head;
+    while (next != NULL && (char *)next->base < pages) {
+        prev = next;
+        next = next->next;
+    }
+    size_t max_chunk = list->config.max_chunk;
+    bool below = next != NULL && pages + length == (char *)next->base && next->length + length <= max_chunk;
+    bool above = prev != NULL && (char *)prev->base + prev->length == pages && prev->length + length <= max_chunk;
+    if (below && above && prev->length + length + next->length <= max_chunk) return region_join(list, prev, pages, length, next);
+    if (below) return region_extend_down(next, pages, length);
+    if (above) return region_extend_up(list, prev, pages, length);
+
+    block_header_t *block = block_format_region(pages + BLOCK_PAD, length - BLOCK_PAD - REGION_TRAILER_SIZE);
+
+    // Linked between its neighbours, so the list stays in address order
+    region_t *region = region_of_epilogue(block_next(block));
+    region->base = pages;
+    region->length = length;
+    region->prev = prev;
+    region->next = next;
+    if (prev) prev->next = region;
+    else list->head = region;
+    if (next) next->prev = region;
+
+    STAT_ADD(list->num_regions, 1);
+
+    return block;
+}
+
+bool region_try_release(region_list_t *list, block_header_t *block) {
+    if (!region_is_unused(block)) return false;
+
+    region_t *region = region_of_epilogue(block_next(block));
+
+    // Hysteresis: keep a floor of mapped memory so a heap hovering around one
+    // region's worth of live data doesn't mmap/munmap on every operation
+    if (list->total_mapped - region->length < list->config.retain_bytes) return false;
+
+    // The trailer lives inside the mapping, read it before unmapping
+    region_t *prev = region->prev;
+    region_t *next = region->next;
+    size_t length = region->length;
+    if (unmap_pages(region->base, length) != 0) return false;
+
+    if (prev) prev->next = next;
+    else list->head = next;
+    if (next) next->prev = prev;
+
+    STAT_SUB(list->num_regions, 1);
+    STAT_SUB(list->total_mapped, length);
+    STAT_ADD(list->total_released, length);
+
+    return true;
+}
+
+/**
+ * Hands the whole pages inside a dirty free block's payload back to the OS and takes it off
+ * the dirty list. The header and the footer stay committed, so the block can still be
+ * coalesced and reused without touching the purged pages
+ */
+static void purge_block(region_list_t *list, block_header_t *block) {
+    // The free list links in the first payload words stay committed too
+    uintptr_t start = (uintptr_t)block + sizeof(block_header_t);
+    uintptr_t end = (uintptr_t)block + HEADER_SIZE + block_size(block) - FOOTER_SIZE;
+    start = (start + PAGE_SIZE - 1) & ~(uintptr_t)(PAGE_SIZE - 1);
+    end &= ~(uintptr_t)(PAGE_SIZE - 1);
+
+    // Unlinked first, the dirty links may sit on the first purged page
+    region_forget_free(list, block);
+    if (end > start) {
+#ifdef MADV_FREE
+        int advice = list->config.purge_lazy ? MADV_FREE : MADV_DONTNEED;
+#else
+        int advice = MADV_DONTNEED;
+#endif
+        if (madvise((void *)start, end - start, advice) != 0) {
+            dirty_push(list, block);
+            return;
+        }
+        list->total_purged += end - start;
+    }
+    block_set(block, BLOCK_PURGED, true);
+}
+
+/**
+ * Purges the blocks on the dirty list. With spare_current, blocks dirtied in the
+ * current epoch have not waited out a full decay period and are left alone
+ */
+static void purge_sweep(region_list_t *list, bool spare_current) {
+    block_header_t *block = list->dirty_head;
+    while (block != NULL) {
+        block_header_t *next = dirty_links(block)->next;
+        if (!(spare_current && block_epoch(block) == list->purge_epoch)) purge_block(list, block);
+        block = next;
+    }
+}
+
+void region_decay(region_list_t *list) {
+    // Each sweep closes an epoch, so a block stays committed between one and two decay periods
+    if (list->dirty_head == NULL) return;
+    unsigned long long now = now_ms();
+    if (now < list->next_purge_ms) return;
+
+    purge_sweep(list, true);
+    list->purge_epoch++;
+    list->next_purge_ms = now + list->config.decay_ms;
+}
+
+void region_note_free(region_list_t *list, block_header_t *block) {
+    // Untouched pages, e.g. a fresh mapping, and small blocks have nothing to purge
+    if (region_is_dirty(list, block)) {
+        block_set_epoch(block, list->purge_epoch);
+        dirty_push(list, block);
+        if (list->config.decay_ms == 0) {
+            purge_block(list, block);
+            return;
+        }
+    }
+    // Other frees only read the clock every DECAY_CHECK_OPS, a new dirty block right away
+    else if (++list->decay_ops < DECAY_CHECK_OPS) {
+        return;
+    }
+
+    list->decay_ops = 0;
+    region_decay(list);
+}
+
+void region_purge_all(region_list_t *list) {
+    purge_sweep(list, false);
+}
+
+void region_walk(region_t *region, block_visit_fn visit, void *ctx) {
+    block_header_t *block = region_first_block(region);
+    // Loaded once per block, an allocated block's owner may be updating its tags
+    size_t flags;
+    while (((flags = block_flags(block)) & BLOCK_SIZE_MASK) != 0) {
+        visit((char *)block + HEADER_SIZE, flags & BLOCK_SIZE_MASK, (flags & BLOCK_FREE) != 0, ctx);
+        block = (block_header_t *)((char *)block + HEADER_SIZE + (flags & BLOCK_SIZE_MASK));
+    }
+}
+
+void region_list_destroy(region_list_t *list) {
+    region_t *region = list->head;
+    while (region != NULL) {
+        // The trailer goes with the mapping
+        region_t *next = region->next;
+        size_t length = region->length;
+        if (unmap_pages(region->base, length) == 0) {
+            STAT_SUB(list->total_mapped, length);
+            STAT_ADD(list->total_released, length);
+        }
+        region = next;
+    }
+    list->head = NULL;
+    STAT_SET(list->num_regions, 0);
+    list->dirty_head = NULL;
+
+    // Regions committed from the reservation were unmapped with it, only the untouched tail is left
+    if (list->reserve_next != NULL && list->reserve_next < list->reserve_end) {
+        munmap(list->reserve_next, (size_t)(list->reserve_end - list->reserve_next));
+    }
+    list->reserve_next = NULL;
+    list->reserve_end = NULL;
+}
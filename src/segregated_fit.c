@@ -0,0 +1,131 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "segregated_fit.h"
+#include "region.h"
+
+#define SMALL_BIN_COUNT SEGREGATED_FIT_SMALL_BIN_COUNT
+#define SMALL_BIN_LIMIT (SMALL_BIN_COUNT * BLOCK_ALIGN)
+#define NUM_BINS SEGREGATED_FIT_NUM_BINS
+#define BITMAP_WORDS SEGREGATED_FIT_BITMAP_WORDS
+
+// How many blocks of a large bin are inspected before moving up a bin
+#define LARGE_BIN_SCAN_LIMIT 4
+
+static size_t floor_log2(size_t size) {
+    return (sizeof(size_t) * 8 - 1) - __builtin_clzl(size);
+}
+
+/**
+ * Maps a free block size to the bin that holds it. Blocks span a multiple of
+ * BLOCK_ALIGN, so small bins are indexed by header plus payload
+ */
+static size_t bin_index(size_t size) {
+    size_t footprint = size + HEADER_SIZE;
+    if (footprint < SMALL_BIN_LIMIT) return footprint / BLOCK_ALIGN;
+    return SMALL_BIN_COUNT + floor_log2(footprint) - floor_log2(SMALL_BIN_LIMIT);
+}
+
+static void free_lists_init(segregated_fit_heap_t *heap) {
+    for (size_t i = 0; i < NUM_BINS; i++) heap->bins[i] = NULL;
+    for (size_t i = 0; i < BITMAP_WORDS; i++) heap->bin_bitmap[i] = 0;
+}
+
+static void free_lists_insert(segregated_fit_heap_t *heap, block_header_t *block) {
+    size_t idx = bin_index(block_size(block));
+
+    block->prev_free = NULL;
+    block->next_free = heap->bins[idx];
+    if (heap->bins[idx]) heap->bins[idx]->prev_free = block;
+    heap->bins[idx] = block;
+
+    heap->bin_bitmap[idx / 64] |= (uint64_t)1 << (idx % 64);
+}
+
+static void free_lists_remove(segregated_fit_heap_t *heap, block_header_t *block) {
+    size_t idx = bin_index(block_size(block));
+
+    if (block->prev_free) block->prev_free->next_free = block->next_free;
+    else heap->bins[idx] = block->next_free;
+    if (block->next_free) block->next_free->prev_free = block->prev_free;
+
+    if (heap->bins[idx] == NULL) heap->bin_bitmap[idx / 64] &= ~((uint64_t)1 << (idx % 64));
+}
+
+/**
+ * Moves the tail split off a free block to the bin of its own size
+ */
+static void free_lists_replace(segregated_fit_heap_t *heap, block_header_t *old, block_header_t *block) {
+    free_lists_remove(heap, old);
+    free_lists_insert(heap, block);
+}
+
+/**
+ * Returns the lowest non-empty bin at or above from, or NUM_BINS if there is none
+ */
+static size_t find_nonempty_bin(segregated_fit_heap_t *heap, size_t from) {
+    for (size_t word = from / 64; word < BITMAP_WORDS; word++) {
+        uint64_t bits = heap->bin_bitmap[word];
+        if (word == from / 64) bits &= ~(uint64_t)0 << (from % 64);
+        if (bits) return word * 64 + __builtin_ctzll(bits);
+    }
+    return NUM_BINS;
+}
+
+/**
+ * Returns the size of the largest free block. Only the highest non-empty bin can hold it,
+ * and a small bin holds a single size
+ */
+static size_t find_largest_free(segregated_fit_heap_t *heap) {
+    for (size_t word = BITMAP_WORDS; word-- > 0;) {
+        uint64_t bits = heap->bin_bitmap[word];
+        if (!bits) continue;
+
+        size_t idx = word * 64 + 63 - __builtin_clzll(bits);
+        if (idx < SMALL_BIN_COUNT) return block_size(heap->bins[idx]);
+
+        size_t largest = 0;
+        for (block_header_t *curr = heap->bins[idx]; curr != NULL; curr = curr->next_free) {
+            if (block_size(curr) > largest) largest = block_size(curr);
+        }
+        return largest;
+    }
+    return 0;
+}
+
+/**
+ * Finds a free block of at least size bytes in constant time
+ */
+static block_header_t *find_fit(segregated_fit_heap_t *heap, size_t size) {
+    size_t idx = bin_index(size);
+
+    if (idx < SMALL_BIN_COUNT) {
+        // Small heap->bins hold a single size, so any block there is an exact fit
+        if (heap->bins[idx]) {
+            COUNTER_ADD(heap, search_steps, 1);
+            return heap->bins[idx];
+        }
+    }
+    else {
+        // Large heap->bins span a power of two, only the first few blocks are checked
+        block_header_t *curr = heap->bins[idx];
+        for (int i = 0; curr != NULL && i < LARGE_BIN_SCAN_LIMIT; i++) {
+            COUNTER_ADD(heap, search_steps, 1);
+            if (block_size(curr) >= size) return curr;
+            curr = curr->next_free;
+        }
+    }
+
+    // Every block in a higher bin is large enough
+    size_t fit = find_nonempty_bin(heap, idx + 1);
+    if (fit == NUM_BINS) return NULL;
+    COUNTER_ADD(heap, search_steps, 1);
+    return heap->bins[fit];
+}
+
+#define FIT_PREFIX segregated_fit
+#define FIT_HEAP segregated_fit_heap_t
+#include "fit_engine.h"
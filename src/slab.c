@@ -0,0 +1,207 @@
+#include <sys/mman.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "slab.h"
+#define PAGE_SIZE 4096
+
+slab_reservation_t slab_reservation = { NULL, NULL, NULL };
+
+int slab_reset() {
+    if (slab_reservation.base == NULL) {
+        // One extra slab of slack so the start can be aligned to SLAB_SIZE
+        size_t length = SLAB_RESERVE_BYTES + SLAB_SIZE;
+        void *reserved = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE | MAP_NORESERVE, -1, 0);
+        if (reserved == MAP_FAILED) return -1;
+
+        char *base = (char *)(((uintptr_t)reserved + SLAB_SIZE - 1) & ~(uintptr_t)(SLAB_SIZE - 1));
+        slab_reservation.end = base + SLAB_RESERVE_BYTES;
+        slab_reservation.base = base;
+    }
+
+    // Slabs of the previous heap are recycled along with it
+    __atomic_store_n(&slab_reservation.next, slab_reservation.base, __ATOMIC_RELAXED);
+    return 0;
+}
+
+void slab_cache_init(slab_cache_t *cache, unsigned char arena) {
+    for (size_t i = 0; i < SLAB_NUM_CLASSES; i++) cache->partial[i] = NULL;
+    cache->empty = NULL;
+    cache->arena = arena;
+    cache->num_slabs = 0;
+    cache->currently_allocated = 0;
+    cache->num_allocated = 0;
+}
+
+static void slab_list_push(slab_t **head, slab_t *slab) {
+    slab->prev = NULL;
+    slab->next = *head;
+    if (*head) (*head)->prev = slab;
+    *head = slab;
+}
+
+static void slab_list_remove(slab_t **head, slab_t *slab) {
+    if (slab->prev) slab->prev->next = slab->next;
+    if (slab->next) slab->next->prev = slab->prev;
+    if (slab == *head) *head = slab->next;
+}
+
+/**
+ * Takes an empty slab, or carves a new one from the reservation, and formats it for a class
+ */
+static slab_t *slab_new(slab_cache_t *cache, size_t class_idx) {
+    slab_t *slab = cache->empty;
+    if (slab != NULL) {
+        slab_list_remove(&cache->empty, slab);
+    }
+    else {
+        if (slab_reservation.base == NULL) return NULL;
+        char *next = __atomic_fetch_add(&slab_reservation.next, SLAB_SIZE, __ATOMIC_RELAXED);
+        if (next + SLAB_SIZE > slab_reservation.end) return NULL;
+        slab = (slab_t *)next;
+        STAT_ADD(cache->num_slabs, 1);
+    }
+
+    slab->slot_size = (class_idx + 1) * SLAB_GRANULE;
+    slab->class_idx = class_idx;
+    slab->arena = cache->arena;
+    slab->capacity = (SLAB_SIZE - SLAB_HEADER_SIZE) / slab->slot_size;
+    slab->used = 0;
+    slab->free_list = NULL;
+    slab->bump = (char *)slab + SLAB_HEADER_SIZE;
+#ifdef TDMM_HARDENED
+    for (size_t i = 0; i < SLAB_MAX_SLOTS / 64; i++) __atomic_store_n(&slab->live[i], 0, __ATOMIC_RELAXED);
+#endif
+
+    slab_list_push(&cache->partial[class_idx], slab);
+    return slab;
+}
+
+void *slab_malloc(slab_cache_t *cache, size_t size) {
+    if (size == 0) return NULL;
+
+    size_t class_idx = (size + SLAB_GRANULE - 1) / SLAB_GRANULE - 1;
+    slab_t *slab = cache->partial[class_idx];
+    if (slab == NULL) {
+        slab = slab_new(cache, class_idx);
+        if (slab == NULL) return NULL;
+    }
+
+    void *slot = slab->free_list;
+    if (slot != NULL) {
+        slab->free_list = *(void **)slot;
+    }
+    else {
+        slot = slab->bump;
+        slab->bump += slab->slot_size;
+    }
+
+    // Full slabs leave the partial list until a slot comes back
+    if (++slab->used == slab->capacity) slab_list_remove(&cache->partial[class_idx], slab);
+
+    STAT_ADD(cache->currently_allocated, slab->slot_size);
+    STAT_ADD(cache->num_allocated, 1);
+#ifdef TDMM_HARDENED
+    slab_mark_live(slot);
+#endif
+    return slot;
+}
+
+void slab_free(slab_cache_t *cache, void *ptr) {
+    slab_t *slab = slab_of(ptr);
+
+    *(void **)ptr = slab->free_list;
+    slab->free_list = ptr;
+    STAT_SUB(cache->currently_allocated, slab->slot_size);
+    STAT_SUB(cache->num_allocated, 1);
+
+    if (slab->used-- == slab->capacity) slab_list_push(&cache->partial[slab->class_idx], slab);
+
+    // Keep one partial slab per class so a class hovering around a slab boundary
+    // doesn't bounce; further empty slabs give their pages back and wait for reuse
+    if (slab->used == 0 && (slab->next != NULL || slab->prev != NULL)) {
+        slab_list_remove(&cache->partial[slab->class_idx], slab);
+        slab_list_push(&cache->empty, slab);
+        madvise((char *)slab + PAGE_SIZE, SLAB_SIZE - PAGE_SIZE, MADV_DONTNEED);
+    }
+}
+
+#ifdef TDMM_HARDENED
+/**
+ * Returns the index of the slot ptr starts, or SIZE_MAX if it doesn't start one
+ */
+static size_t slot_index(slab_t *slab, const void *ptr) {
+    size_t offset = (size_t)((const char *)ptr - (char *)slab);
+    // Slabs that were never carved read as zero
+    if (slab->slot_size == 0 || offset < SLAB_HEADER_SIZE) return SIZE_MAX;
+
+    offset -= SLAB_HEADER_SIZE;
+    if (offset % slab->slot_size != 0 || offset / slab->slot_size >= slab->capacity) return SIZE_MAX;
+    return offset / slab->slot_size;
+}
+
+void slab_mark_live(void *ptr) {
+    slab_t *slab = slab_of(ptr);
+    size_t idx = slot_index(slab, ptr);
+    __atomic_fetch_or(&slab->live[idx / 64], (uint64_t)1 << (idx % 64), __ATOMIC_RELAXED);
+}
+
+bool slab_claim(void *ptr) {
+    slab_t *slab = slab_of(ptr);
+    size_t idx = slot_index(slab, ptr);
+    if (idx == SIZE_MAX) return false;
+
+    uint64_t bit = (uint64_t)1 << (idx % 64);
+    return (__atomic_fetch_and(&slab->live[idx / 64], ~bit, __ATOMIC_RELAXED) & bit) != 0;
+}
+#endif
+
+void slab_walk(slab_t *slab, block_visit_fn visit, void *ctx) {
+    char *slots = (char *)slab + SLAB_HEADER_SIZE;
+    size_t carved = (size_t)(slab->bump - slots) / slab->slot_size;
+
+    // An empty slab's pages were purged along with its free list, every slot is free
+    uint64_t free_slots[SLAB_MAX_SLOTS / 64];
+    memset(free_slots, slab->used == 0 ? 0xff : 0, sizeof(free_slots));
+    if (slab->used != 0) {
+        for (char *slot = slab->free_list; slot != NULL; slot = *(char **)slot) {
+            size_t idx = (size_t)(slot - slots) / slab->slot_size;
+            free_slots[idx / 64] |= (uint64_t)1 << (idx % 64);
+        }
+    }
+
+    for (size_t idx = 0; idx < carved; idx++) {
+        bool free = (free_slots[idx / 64] >> (idx % 64)) & 1;
+        visit(slots + idx * slab->slot_size, slab->slot_size, free, ctx);
+    }
+}
+
+/**
+ * Returns the bytes of every slab carved for this cache
+ */
+size_t slab_get_total_mapped_memory(slab_cache_t *cache) {
+    return STAT_LOAD(cache->num_slabs) * SLAB_SIZE;
+}
+
+/**
+ * Returns the bytes of every slot in use
+ */
+size_t slab_get_currently_allocated_memory(slab_cache_t *cache) {
+    return STAT_LOAD(cache->currently_allocated);
+}
+
+/**
+ * Returns the number of slots in use
+ */
+size_t slab_get_num_allocated(slab_cache_t *cache) {
+    return STAT_LOAD(cache->num_allocated);
+}
+
+/**
+ * Slots carry no header, the only metadata is one header per slab
+ */
+size_t slab_get_structural_overhead(slab_cache_t *cache) {
+    return STAT_LOAD(cache->num_slabs) * SLAB_HEADER_SIZE;
+}
@@ -0,0 +1,133 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "tlsf.h"
+#include "region.h"
+
+#define SL_INDEX_COUNT_LOG2 TLSF_SL_INDEX_COUNT_LOG2
+#define SL_INDEX_COUNT TLSF_SL_INDEX_COUNT
+#define FL_INDEX_SHIFT TLSF_FL_INDEX_SHIFT
+#define FL_INDEX_COUNT TLSF_FL_INDEX_COUNT
+// Sizes below this all live in first level 0, one second level list per BLOCK_ALIGN bytes
+#define SMALL_BLOCK_SIZE ((size_t)1 << FL_INDEX_SHIFT)
+
+static int floor_log2(size_t size) {
+    return (int)(sizeof(size_t) * 8 - 1) - __builtin_clzl(size);
+}
+
+/**
+ * Computes the first and second level indices of the list holding heap->blocks of this size
+ */
+static void mapping_insert(size_t size, int *fl, int *sl) {
+    if (size < SMALL_BLOCK_SIZE) {
+        *fl = 0;
+        *sl = (int)(size / (SMALL_BLOCK_SIZE / SL_INDEX_COUNT));
+    }
+    else {
+        int log2 = floor_log2(size);
+        *sl = (int)(size >> (log2 - SL_INDEX_COUNT_LOG2)) ^ SL_INDEX_COUNT;
+        *fl = log2 - (FL_INDEX_SHIFT - 1);
+    }
+}
+
+/**
+ * Like mapping_insert, but rounds up so every block of the resulting list fits size
+ */
+static void mapping_search(size_t size, int *fl, int *sl) {
+    if (size >= SMALL_BLOCK_SIZE) {
+        size_t round = ((size_t)1 << (floor_log2(size) - SL_INDEX_COUNT_LOG2)) - 1;
+        if (size <= SIZE_MAX - round) size += round;
+    }
+    mapping_insert(size, fl, sl);
+}
+
+static void free_lists_init(tlsf_heap_t *heap) {
+    for (int fl = 0; fl < FL_INDEX_COUNT; fl++) {
+        for (int sl = 0; sl < SL_INDEX_COUNT; sl++) heap->blocks[fl][sl] = NULL;
+        heap->sl_bitmap[fl] = 0;
+    }
+    heap->fl_bitmap = 0;
+}
+
+static void free_lists_insert(tlsf_heap_t *heap, block_header_t *block) {
+    int fl, sl;
+    mapping_insert(block_size(block), &fl, &sl);
+
+    block->prev_free = NULL;
+    block->next_free = heap->blocks[fl][sl];
+    if (heap->blocks[fl][sl]) heap->blocks[fl][sl]->prev_free = block;
+    heap->blocks[fl][sl] = block;
+
+    heap->fl_bitmap |= (uint64_t)1 << fl;
+    heap->sl_bitmap[fl] |= (uint32_t)1 << sl;
+}
+
+static void free_lists_remove(tlsf_heap_t *heap, block_header_t *block) {
+    int fl, sl;
+    mapping_insert(block_size(block), &fl, &sl);
+
+    if (block->prev_free) block->prev_free->next_free = block->next_free;
+    else heap->blocks[fl][sl] = block->next_free;
+    if (block->next_free) block->next_free->prev_free = block->prev_free;
+
+    if (heap->blocks[fl][sl] == NULL) {
+        heap->sl_bitmap[fl] &= ~((uint32_t)1 << sl);
+        if (heap->sl_bitmap[fl] == 0) heap->fl_bitmap &= ~((uint64_t)1 << fl);
+    }
+}
+
+/**
+ * Moves the tail split off a free block to the list of its own size
+ */
+static void free_lists_replace(tlsf_heap_t *heap, block_header_t *old, block_header_t *block) {
+    free_lists_remove(heap, old);
+    free_lists_insert(heap, block);
+}
+
+/**
+ * Finds a free block of at least size bytes with two bitmap lookups
+ */
+static block_header_t *find_fit(tlsf_heap_t *heap, size_t size) {
+    int fl, sl;
+    mapping_search(size, &fl, &sl);
+    if (fl >= FL_INDEX_COUNT) return NULL;
+
+    // Look for a list in the same first level, at or above sl
+    uint32_t sl_map = heap->sl_bitmap[fl] & (~(uint32_t)0 << sl);
+    if (!sl_map) {
+        // Fall back to the smallest non-empty higher first level
+        if (fl + 1 >= FL_INDEX_COUNT) return NULL;
+        uint64_t fl_map = heap->fl_bitmap & (~(uint64_t)0 << (fl + 1));
+        if (!fl_map) return NULL;
+
+        fl = __builtin_ctzll(fl_map);
+        sl_map = heap->sl_bitmap[fl];
+    }
+    sl = __builtin_ctz(sl_map);
+
+    // The head of a non-empty list always fits, it is the only block looked at
+    COUNTER_ADD(heap, search_steps, 1);
+    return heap->blocks[fl][sl];
+}
+
+/**
+ * Returns the size of the largest free block, which sits in the highest non-empty list
+ */
+static size_t find_largest_free(tlsf_heap_t *heap) {
+    if (!heap->fl_bitmap) return 0;
+    int fl = 63 - __builtin_clzll(heap->fl_bitmap);
+    int sl = 31 - __builtin_clz(heap->sl_bitmap[fl]);
+
+    size_t largest = 0;
+    for (block_header_t *curr = heap->blocks[fl][sl]; curr != NULL; curr = curr->next_free) {
+        if (block_size(curr) > largest) largest = block_size(curr);
+    }
+    return largest;
+}
+
+#define FIT_PREFIX tlsf
+#define FIT_HEAP tlsf_heap_t
+#include "fit_engine.h"
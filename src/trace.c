@@ -0,0 +1,125 @@
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+#ifdef TDMM_TRACE
+#ifdef TDMM_THREAD_SAFE
+#include <pthread.h>
+#endif
+
+// Events buffered before each write, the buffer is never allocated from the heap being traced
+#define TRACE_BUFFER_EVENTS 4096
+
+static int trace_fd = -1;
+static bool trace_active;
+static uint64_t trace_start_ns;
+static trace_event_t trace_buffer[TRACE_BUFFER_EVENTS];
+static size_t trace_buffered;
+
+#ifdef TDMM_THREAD_SAFE
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+#define trace_lock_acquire() pthread_mutex_lock(&trace_lock)
+#define trace_lock_release() pthread_mutex_unlock(&trace_lock)
+#else
+#define trace_lock_acquire()
+#define trace_lock_release()
+#endif
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static bool write_all(const void *data, size_t length) {
+    const char *curr = data;
+    while (length > 0) {
+        ssize_t written = write(trace_fd, curr, length);
+        if (written <= 0) return false;
+        curr += written;
+        length -= (size_t)written;
+    }
+    return true;
+}
+
+/**
+ * Writes out the buffered events, caller holds the trace lock. A failed write ends the
+ * trace, the file then holds every event up to the last complete batch
+ */
+static void trace_flush_locked() {
+    if (trace_buffered > 0 && !write_all(trace_buffer, trace_buffered * sizeof(trace_event_t))) {
+        __atomic_store_n(&trace_active, false, __ATOMIC_RELAXED);
+    }
+    trace_buffered = 0;
+}
+
+int trace_open(const char *path) {
+    trace_lock_acquire();
+    if (trace_fd >= 0) {
+        trace_lock_release();
+        return -1;
+    }
+
+    trace_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (trace_fd < 0) {
+        trace_lock_release();
+        return -1;
+    }
+
+    trace_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    header.version = TRACE_VERSION;
+    header.event_size = sizeof(trace_event_t);
+    if (!write_all(&header, sizeof(header))) {
+        close(trace_fd);
+        trace_fd = -1;
+        trace_lock_release();
+        return -1;
+    }
+
+    trace_buffered = 0;
+    trace_start_ns = now_ns();
+    __atomic_store_n(&trace_active, true, __ATOMIC_RELEASE);
+    trace_lock_release();
+    return 0;
+}
+
+void trace_close() {
+    trace_lock_acquire();
+    if (trace_fd >= 0) {
+        __atomic_store_n(&trace_active, false, __ATOMIC_RELAXED);
+        trace_flush_locked();
+        close(trace_fd);
+        trace_fd = -1;
+    }
+    trace_lock_release();
+}
+
+void trace_log(trace_op_e op, const void *ptr, uintptr_t arg, size_t size) {
+    // The only cost while no trace is open
+    if (!__atomic_load_n(&trace_active, __ATOMIC_ACQUIRE)) return;
+
+    trace_lock_acquire();
+    // Stopped while this thread waited for the lock
+    if (!trace_active) {
+        trace_lock_release();
+        return;
+    }
+
+    trace_event_t *event = &trace_buffer[trace_buffered++];
+    event->time_ns = now_ns() - trace_start_ns;
+    event->ptr = (uint64_t)(uintptr_t)ptr;
+    event->arg = (uint64_t)arg;
+    event->op_size = ((uint64_t)op << TRACE_OP_SHIFT) | ((uint64_t)size & TRACE_SIZE_MASK);
+
+    if (trace_buffered == TRACE_BUFFER_EVENTS) trace_flush_locked();
+    trace_lock_release();
+}
+#endif